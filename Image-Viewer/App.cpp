@@ -1,4 +1,5 @@
 ﻿#include "App.h"
+#include "SaveService.h"
 #include "stb_image.h"
 #include <algorithm>
 #include <string>
@@ -20,10 +21,11 @@ App::~App() {
 		if (t.joinable())
 			t.join();
 	}
-	ImageManagment::deleteInstance();
-	delete shader;
 	App::windowMutex.lock();
 	glfwMakeContextCurrent(App::window);
+	// The upload queue releases its pixel buffers and textures, the context has to be current for that
+	ImageManagment::deleteInstance();
+	delete shader;
 
 	ImGui_ImplOpenGL3_Shutdown();
 	ImGui_ImplGlfw_Shutdown();
@@ -71,6 +73,7 @@ void App::runApp()
 
 			glClear(GL_COLOR_BUFFER_BIT);
 
+			ImageManagment::getInstance()->processUploads();
 			update();
 
 			ImGui::Render();
@@ -128,6 +131,9 @@ int App::start()
 		App::windowMutex.unlock();
 		return -1;
 	}
+	int maxTextureSize = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+	TiledImage::setMaxTextureSize(maxTextureSize);
 	glfwSetKeyCallback(window, keyPressed);
 	glfwSetScrollCallback(window, scroll);
 	glfwSetMouseButtonCallback(window, mouseClick);
@@ -195,6 +201,7 @@ void App::drawImage()
 		h = h * 5 / 6;
 	viewWidth = w;
 	viewHeight = h;
+	ImageManagment::getInstance()->setViewSize(w, h);
 	if (currImage == nullptr || currImage->texId == -1) {
 		draw->AddRectFilled({ 0, 0 }, { (float)w , (float) h }, isLight ? IM_COL32(230, 230, 230, 255) : IM_COL32(10, 10, 10, 255));
 		return;
@@ -249,6 +256,10 @@ void App::drawImage()
 	currImage->mod.positions[3].y = -p4.y / rh * 2.0f + 1.0f;
 
 	shader->drawImageWithModification(currImage->texId, currImage);
+
+	std::shared_ptr<TiledImage> tiles = ImageManagment::getInstance()->getTiles(currImage);
+	if (tiles)
+		tiles->draw(shader, currImage, (float)(scale * zoom), UPLOAD_TIME_BUDGET);
 }
 
 void App::drawBoundingBox()
@@ -280,6 +291,8 @@ void App::drawBoundingBox()
 void App::drawImageStrip()
 {
 	ImDrawList* draw = ImGui::GetBackgroundDrawList();
+	ThumbnailCache* thumbnails = ImageManagment::getInstance()->getThumbnails();
+	thumbnails->process();
 	int selected = ImageManagment::getInstance()->getCurrentImageIndex();
 	int w, h, x, y, vw;
 	glfwGetFramebufferSize(window, &vw, &h);
@@ -290,71 +303,94 @@ void App::drawImageStrip()
 
 	draw->AddRectFilled({ (float)0, (float)y }, { (float)vw, (float)y + h }, isLight ? IM_COL32(230, 230, 230, 200) : IM_COL32(10, 10, 10, 200));
 
+	struct StripQuad {
+		unsigned int texId;
+		ImVec2 p[4];
+		ImVec2 uv[4];
+	};
+	std::vector<StripQuad> quads;
+	ImVec2 selectedMin, selectedMax;
+	bool hasSelected = false;
+
+	// Only the slots on screen. Placeholders first, then the thumbnails grouped by atlas page so
+	// ImGui merges them in one draw command per page, then the outlines
 	int n = ImageManagment::getInstance()->getNumberOfImages();
-	int i = 0;
-	while (i <= n) {
-		if (i == selected) {
-			i++;
-			continue;
-		}
-		if (i == n) {
-			i = selected;
-		}
+	int first = max(0, -x / (w + STRIP_DISTANCE) - 1);
+	int last = min(n - 1, (vw - x) / (w + STRIP_DISTANCE) + 1);
+	for (int i = first; i <= last; i++) {
 		Image* img_ptr = ImageManagment::getInstance()->getImageAt(i);
-		if (img_ptr == nullptr) {
-			i = n+1;
+		if (img_ptr == nullptr)
+			break;
+		Image& img = *img_ptr;
+		Thumbnail thumbnail;
+		bool hasThumbnail = thumbnails->get(img.imagePath, thumbnail);
+		float ih = img.h, iw = img.w;
+		if (img.texId == -1 && hasThumbnail) {
+			ih = thumbnail.h;
+			iw = thumbnail.w;
+		}
+		if ((!hasThumbnail && img.texId == -1) || iw <= 0 || ih <= 0) {
+			draw->AddRectFilled({ (float)x + (w + STRIP_DISTANCE) * i, (float)y }, { (float)x + (w + STRIP_DISTANCE) * (i + 1) - STRIP_DISTANCE , (float)y + h }, isLight ? IM_COL32(230, 230, 230, 255) : IM_COL32(10, 10, 10, 255));
 			continue;
 		}
-		Image img = *img_ptr;
-		float ih = img.h, iw = img.w;
 		double scale = min((double)h / (double)ih, (double)w / (double)iw);
-		iw = scale * img.w;
-		ih = scale * img.h;
-		if (img.texId == -1) {
-			draw->AddRectFilled({ (float)x + (w + STRIP_DISTANCE) * i, (float)y }, { (float)x + (w + STRIP_DISTANCE) * (i + 1) - STRIP_DISTANCE , (float)y + h }, isLight ? IM_COL32(230, 230, 230, 255) : IM_COL32(10, 10, 10, 255));
+		iw = scale * iw;
+		ih = scale * ih;
+		float y1 = (float)(y + ((h - ih) / 2));
+		float x1 = (float)x + (w + STRIP_DISTANCE) * i;
+		float y2 = y1 + ih;
+		float x2 = x1 + iw;
+
+		StripQuad quad = { hasThumbnail ? thumbnail.texId : img.texId, { { x1, y1 }, { x2, y1 }, { x2, y2 }, { x1, y2 } } };
+		for (int c = 0; c < 4; c++) {
+			quad.uv[c] = img.uv[c];
+			if (hasThumbnail)
+				quad.uv[c] = { thumbnail.uv0.x + img.uv[c].x * (thumbnail.uv1.x - thumbnail.uv0.x), thumbnail.uv0.y + img.uv[c].y * (thumbnail.uv1.y - thumbnail.uv0.y) };
 		}
-		else {
-			float y1 = (float)(y + ((h - ih) / 2));
-			float x1 = (float)x + (w + STRIP_DISTANCE) * i;
-
-			float y2 = y1 + ih;
-			float x2 = x1 + iw;
-			draw->AddImageQuad((void*)img.texId, { x1,y1 }, { x2, y1 }, { x2, y2 }, { x1, y2 }, img.uv[0], img.uv[1], img.uv[2], img.uv[3]);
-
+		quads.push_back(quad);
+		if (i == selected) {
+			selectedMin = { x1, y1 };
+			selectedMax = { x2, y2 };
+			hasSelected = true;
+		}
+	}
 
-			if (i == selected) {
-				float zoom = ImageManagment::getInstance()->getZoom();
-				ImVec2 t = { -ImageManagment::getInstance()->getTranslationX() * iw / zoom, -ImageManagment::getInstance()->getTranslationY() * ih / zoom};
-				ImVec2 q1 = { x1 + iw / 2 - viewWidth / imageWidth * iw / 2, y1 + ih / 2 - viewHeight / imageHeight * ih / 2 };
-				ImVec2 q2 = { q1.x + viewWidth / imageWidth * iw, q1.y + viewHeight / imageHeight * ih };
+	std::stable_sort(quads.begin(), quads.end(), [](const StripQuad& a, const StripQuad& b) { return a.texId < b.texId; });
+	stripBatches = 0;
+	for (int q = 0; q < quads.size(); q++) {
+		if (q == 0 || quads[q].texId != quads[q - 1].texId)
+			stripBatches++;
+		draw->AddImageQuad((void*)quads[q].texId, quads[q].p[0], quads[q].p[1], quads[q].p[2], quads[q].p[3], quads[q].uv[0], quads[q].uv[1], quads[q].uv[2], quads[q].uv[3]);
+	}
 
-				float angle = -ImageManagment::getInstance()->getAngle();
+	if (hoverSel != 0 && selected + hoverSel >= first && selected + hoverSel <= last) {
+		int i = selected + hoverSel;
+		draw->AddRect({ (float)x + (w + STRIP_DISTANCE) * i, (float)y }, { (float)x + (w + STRIP_DISTANCE) * (i + 1) - STRIP_DISTANCE , (float)y + h }, IM_COL32(150, 150, 150, 255));
+	}
+	if (hasSelected) {
+		float x1 = selectedMin.x, y1 = selectedMin.y, x2 = selectedMax.x, y2 = selectedMax.y;
+		float iw = x2 - x1, ih = y2 - y1;
+		float zoom = ImageManagment::getInstance()->getZoom();
+		ImVec2 t = { -ImageManagment::getInstance()->getTranslationX() * iw / zoom, -ImageManagment::getInstance()->getTranslationY() * ih / zoom};
+		ImVec2 q1 = { x1 + iw / 2 - viewWidth / imageWidth * iw / 2, y1 + ih / 2 - viewHeight / imageHeight * ih / 2 };
+		ImVec2 q2 = { q1.x + viewWidth / imageWidth * iw, q1.y + viewHeight / imageHeight * ih };
 
-				float px = (x1 + x2) / 2;
-				float py = (y1 + y2) / 2;
+		float angle = -ImageManagment::getInstance()->getAngle();
 
-				x1 = q1.x + t.x;
-				y1 = q1.y + t.y;
-				x2 = q2.x + t.x;
-				y2 = q2.y + t.y;
-				
-				ImVec2 p1 = { (float)((x1 - px) * cos(angle) - (y1 - py) * sin(angle) + px), (float)((x1 - px) * sin(angle) + (y1 - py) * cos(angle) + py) };
-				ImVec2 p2 = { (float)((x2 - px) * cos(angle) - (y1 - py) * sin(angle) + px), (float)((x2 - px) * sin(angle) + (y1 - py) * cos(angle) + py) };
-				ImVec2 p3 = { (float)((x2 - px) * cos(angle) - (y2 - py) * sin(angle) + px), (float)((x2 - px) * sin(angle) + (y2 - py) * cos(angle) + py) };
-				ImVec2 p4 = { (float)((x1 - px) * cos(angle) - (y2 - py) * sin(angle) + px), (float)((x1 - px) * sin(angle) + (y2 - py) * cos(angle) + py) };
+		float px = (x1 + x2) / 2;
+		float py = (y1 + y2) / 2;
 
-				draw->AddQuad(p1, p2, p3, p4, isLight ? IM_COL32(25, 25, 25, 255) : IM_COL32(255, 255, 255, 255), 2.0f);
+		x1 = q1.x + t.x;
+		y1 = q1.y + t.y;
+		x2 = q2.x + t.x;
+		y2 = q2.y + t.y;
 
-			}
+		ImVec2 p1 = { (float)((x1 - px) * cos(angle) - (y1 - py) * sin(angle) + px), (float)((x1 - px) * sin(angle) + (y1 - py) * cos(angle) + py) };
+		ImVec2 p2 = { (float)((x2 - px) * cos(angle) - (y1 - py) * sin(angle) + px), (float)((x2 - px) * sin(angle) + (y1 - py) * cos(angle) + py) };
+		ImVec2 p3 = { (float)((x2 - px) * cos(angle) - (y2 - py) * sin(angle) + px), (float)((x2 - px) * sin(angle) + (y2 - py) * cos(angle) + py) };
+		ImVec2 p4 = { (float)((x1 - px) * cos(angle) - (y2 - py) * sin(angle) + px), (float)((x1 - px) * sin(angle) + (y2 - py) * cos(angle) + py) };
 
-		}
-		if (i == selected + hoverSel && hoverSel != 0) {
-			draw->AddRect({ (float)x + (w + STRIP_DISTANCE) * i, (float)y }, { (float)x + (w + STRIP_DISTANCE) * (i + 1) - STRIP_DISTANCE , (float)y + h }, IM_COL32(150, 150, 150, 255));
-		}
-		if (i == selected) {
-			break;
-		}
-		i++;
+		draw->AddQuad(p1, p2, p3, p4, isLight ? IM_COL32(25, 25, 25, 255) : IM_COL32(255, 255, 255, 255), 2.0f);
 	}
 }
 void App::drawMenu()
@@ -377,14 +413,21 @@ void App::drawMenu()
 					ImGui::InputInt("Width", (&ImageManagment::getInstance()->getCurrentImage()->saveWidth));
 					ImGui::InputInt("Height", (&ImageManagment::getInstance()->getCurrentImage()->saveHeight));
 				}
-				if (ImGui::MenuItem("Save as PNG")) {
-					if (FileDialog::saveFile(L"*.png")) {
-						currentFile = FileDialog::sFilePath;
-						if (!currentFile.ends_with(".png")) {
-							currentFile += ".png";
+				if (ImGui::BeginMenu("Save as PNG")) {
+#ifdef HAS_ZLIB
+					// stb_image_write is used without zlib, it has no level to set
+					ImGui::SliderInt("Compression", &pngCompression, 0, 9);
+#endif
+					if (ImGui::Button("Save")) {
+						if (FileDialog::saveFile(L"*.png")) {
+							currentFile = FileDialog::sFilePath;
+							if (!currentFile.ends_with(".png")) {
+								currentFile += ".png";
+							}
+							queueSave(PNG);
 						}
-						saveImage(*ImageManagment::getInstance()->getCurrentImage(), currentFile, PNG, saveWithTransforms);
 					}
+					ImGui::EndMenu();
 				}
 				if (ImGui::MenuItem("Save as BMP")) {
 					if (FileDialog::saveFile(L"*.bmp")) {
@@ -392,7 +435,7 @@ void App::drawMenu()
 						if (!currentFile.ends_with(".bmp")) {
 							currentFile += ".bmp";
 						}
-						saveImage(*ImageManagment::getInstance()->getCurrentImage(), currentFile, BMP, saveWithTransforms);
+						queueSave(BMP);
 					}
 				}
 				if (ImGui::BeginMenu("Save as JPG")) {
@@ -403,19 +446,39 @@ void App::drawMenu()
 							if (!currentFile.ends_with(".jpg")) {
 								currentFile += ".jpg";
 							}
-							saveImage(*ImageManagment::getInstance()->getCurrentImage(), currentFile, JPG, saveWithTransforms, quality);
+							queueSave(JPG);
 						}
 					}
 					ImGui::EndMenu();
 				}
-				if (ImGui::MenuItem("Save as BIN")) {
-					if (FileDialog::saveFile(L"*.bin")) {
-						currentFile = FileDialog::sFilePath;
-						if (!currentFile.ends_with(".bin")) {
-							currentFile += ".bin";
+				if (ImGui::BeginMenu("Save as BIN")) {
+					ImGui::Checkbox("Tiled with mip levels", &binTiled);
+#ifdef HAS_ZLIB
+					if (binTiled)
+						ImGui::Checkbox("Compress tiles", &binCompressed);
+#endif
+					if (ImGui::Button("Save")) {
+						if (FileDialog::saveFile(L"*.bin")) {
+							currentFile = FileDialog::sFilePath;
+							if (!currentFile.ends_with(".bin")) {
+								currentFile += ".bin";
+							}
+							queueSave(!binTiled ? BIN : binCompressed ? BIN_TILED_COMPRESSED : BIN_TILED);
 						}
-						saveImage(*ImageManagment::getInstance()->getCurrentImage(), currentFile, BIN, saveWithTransforms);
 					}
+					ImGui::EndMenu();
+				}
+				ImGui::Separator();
+				if (ImGui::BeginMenu("Save all images like this")) {
+					ImGui::Text("Every open image is saved with the edits and view of this one,");
+					ImGui::Text("next to it with \"%s\" added to its name.", BATCH_SAVE_SUFFIX);
+					if (ImGui::MenuItem("As PNG"))
+						queueBatchSave(PNG);
+					if (ImGui::MenuItem("As JPG"))
+						queueBatchSave(JPG);
+					if (ImGui::MenuItem("As BMP"))
+						queueBatchSave(BMP);
+					ImGui::EndMenu();
 				}
 				ImGui::EndMenu();
 			}
@@ -462,11 +525,25 @@ void App::drawMenu()
 		
 		if (ImGui::BeginMenu("Options")) {
 			ImGui::Checkbox("Show image strip", &App::showStrip);
+			// Turned off by the upload queue when the driver can't map the buffers
+			usePixelBuffers = ImageManagment::getInstance()->getUsePixelBuffers();
+			if (ImGui::Checkbox("Upload with pixel buffers", &usePixelBuffers)) {
+				ImageManagment::getInstance()->setUsePixelBuffers(usePixelBuffers);
+			}
+			bool budgetsChanged = ImGui::SliderInt("Texture cache (MB)", &textureCacheMB, 64, 8192);
+			budgetsChanged |= ImGui::SliderInt("Decoded image cache (MB)", &pixelCacheMB, 64, 16384);
+			if (budgetsChanged) {
+				ImageManagment::getInstance()->setCacheBudgets((size_t)textureCacheMB << 20, (size_t)pixelCacheMB << 20);
+			}
 			ImGui::Separator();
 			ImGui::Checkbox("Save with transformations", &saveWithTransforms);
 			ImGui::Text("Saving with the transformation saves the image as shown in the image preview.");
 			ImGui::Text("The area that would be saved is in the rectangle in the image preview.");
-			ImGui::Text("Images saved with the transformations will lose quality.");
+			const char* filters[RESAMPLE_COUNT];
+			for (int filter = RESAMPLE_NEAREST; filter < RESAMPLE_COUNT; filter++)
+				filters[filter] = resampleFilterName((ResampleFilter)filter);
+			ImGui::Combo("Resampling", &resampleFilter, filters, RESAMPLE_COUNT);
+			ImGui::Text("Rotated or zoomed saves are resampled with the filter above, nearest keeps the exact pixels.");
 			ImGui::Separator();
 			if (ImGui::Checkbox("Light mode", &isLight)) {
 				if (isLight) {
@@ -480,6 +557,86 @@ void App::drawMenu()
 			}
 			ImGui::EndMenu();
 		}
+		if (ImGui::BeginMenu("Statistics")) {
+			ImGui::Text("Loader queue depth : %d", ImageManagment::getInstance()->getLoaderQueueDepth());
+			ImGui::Text("Processed loader requests : %u", ImageManagment::getInstance()->getProcessedCommands());
+			ImGui::Text("Coalesced loader requests : %u", ImageManagment::getInstance()->getCoalescedCommands());
+			ImGui::Separator();
+			ImGui::Text("Decode threads : %u", ImageManagment::getInstance()->getDecodeThreadCount());
+			ImGui::Text("Pending decodes : %d", ImageManagment::getInstance()->getPendingDecodes());
+			ImGui::Text("Decode generation : %u", ImageManagment::getInstance()->getDecodeGeneration());
+			ImGui::Text("Dropped stale decodes : %u", ImageManagment::getInstance()->getDroppedDecodes());
+			ImGui::Text("Shown from embedded thumbnails : %u", ImageManagment::getInstance()->getEmbeddedPreviews());
+			ImGui::Text("Upload queue depth : %d", ImageManagment::getInstance()->getUploadQueueDepth());
+			ImageCache* cache = ImageManagment::getInstance()->getImageCache();
+			ImGui::Text("Texture cache : %.1f / %d MB, %u hits", cache->getTextureBytes() / (1024.0 * 1024.0), textureCacheMB, cache->getTextureHits());
+			ImGui::Text("Decoded image cache : %.1f / %d MB, %u hits", cache->getPixelBytes() / (1024.0 * 1024.0), pixelCacheMB, cache->getPixelHits());
+			ImGui::Text("Cache misses : %u", cache->getMisses());
+			ImGui::Text("Saves from cached pixels : %u", cache->getReuses());
+			ImGui::Text("Upload throughput (pixel buffers) : %.1f MB/s", ImageManagment::getInstance()->getUploadThroughput(true));
+			ImGui::Text("Upload throughput (direct) : %.1f MB/s", ImageManagment::getInstance()->getUploadThroughput(false));
+			ThumbnailCache* thumbnails = ImageManagment::getInstance()->getThumbnails();
+			ImGui::Text("Thumbnails : %d in %d atlas pages, %d pending", thumbnails->getSlotCount(), thumbnails->getPageCount(), thumbnails->getPendingCount());
+			ImGui::Text("Strip texture batches : %d", stripBatches);
+			ImGui::Text("Thumbnails from disk cache : %u, generated : %u", thumbnails->getDiskHits(), thumbnails->getGenerated());
+			if (currImage != nullptr) {
+				std::shared_ptr<TiledImage> tiles = ImageManagment::getInstance()->getTiles(currImage);
+				if (tiles)
+					ImGui::Text("Resident tiles : %d", tiles->getResidentTiles());
+			}
+			ImGui::Separator();
+			if (ImGui::BeginMenu("Benchmarks", !benchmarks.isRunning())) {
+				if (ImGui::MenuItem("PNG encoders")) {
+					int compression = pngCompression;
+					std::vector<std::string> paths = getBenchmarkImages();
+					benchmarks.run("PNG encoders", [paths, compression](const std::atomic<bool>& stop) {
+						return benchmarkPngEncoders(paths, compression, stop);
+					});
+				}
+				if (ImGui::MenuItem("JPEG encoders")) {
+					int jpegQuality = quality;
+					std::vector<std::string> paths = getBenchmarkImages();
+					benchmarks.run("JPEG encoders", [paths, jpegQuality](const std::atomic<bool>& stop) {
+						return benchmarkJpegEncoders(paths, jpegQuality, stop);
+					});
+				}
+				if (ImGui::MenuItem("HSV kernels")) {
+					benchmarks.run("HSV kernels", [](const std::atomic<bool>& stop) {
+						return benchmarkHsvKernels(stop);
+					});
+				}
+				if (ImGui::MenuItem("Orientations")) {
+					benchmarks.run("Orientations", [](const std::atomic<bool>& stop) {
+						return benchmarkOrientations(stop);
+					});
+				}
+				if (ImGui::MenuItem("Flips")) {
+					benchmarks.run("Flips", [](const std::atomic<bool>& stop) {
+						return benchmarkFlips(stop);
+					});
+				}
+				if (ImGui::MenuItem("Resampling filters")) {
+					benchmarks.run("Resampling filters", [](const std::atomic<bool>& stop) {
+						return benchmarkWarpFilters(stop);
+					});
+				}
+				ImGui::EndMenu();
+			}
+			if (benchmarks.isRunning())
+				ImGui::Text("Running %s ...", benchmarks.getTitle().c_str());
+			for (BenchmarkResult& result : benchmarks.getResults()) {
+				if (result.failed) {
+					ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "FAILED");
+					ImGui::SameLine();
+				}
+				ImGui::Text("%s : %.3f s, %.1f MP/s", result.name.c_str(), result.seconds, result.seconds > 0 ? result.megapixels / result.seconds : 0.0);
+				if (result.outputBytes > 0) {
+					ImGui::SameLine();
+					ImGui::Text(", %.1f MB", result.outputBytes / (1024.0 * 1024.0));
+				}
+			}
+			ImGui::EndMenu();
+		}
 		if (ImGui::BeginMenu("Help")) {
 			ImGui::Text("W A S D (click and drag) - Move the viewport");
 			ImGui::Text("Q E - Rotate the image");
@@ -491,6 +648,7 @@ void App::drawMenu()
 			ImGui::Text("Esc - Exit fullscreen");
 			ImGui::EndMenu();
 		}
+		drawSaves();
 		if (ImGui::MenuItem("+")) {
 			ImageManagment::getInstance()->increaseZoom();
 		}
@@ -513,6 +671,77 @@ void App::drawMenu()
 		ImGui::EndMainMenuBar();
 	}
 }
+std::vector<std::string> App::getBenchmarkImages()
+{
+	std::vector<std::string> paths;
+	for (int i = 0; i < ImageManagment::getInstance()->getNumberOfImages() && paths.size() < BENCHMARK_MAX_IMAGES; i++) {
+		paths.push_back(ImageManagment::getInstance()->getImageAt(i)->imagePath);
+	}
+	return paths;
+}
+void App::queueSave(int type)
+{
+	ViewTransform view = ImageManagment::getInstance()->getViewTransform();
+	view.filter = (ResampleFilter)resampleFilter;
+	ImageManagment::getInstance()->getSaves()->submit(*ImageManagment::getInstance()->getCurrentImage(), currentFile, type,
+		saveWithTransforms, quality, pngCompression, view);
+}
+void App::queueBatchSave(int type)
+{
+	const char* extensions[] = { ".png", ".jpg", ".bmp", ".bin", ".bin", ".bin" };
+	ImageManagment* images = ImageManagment::getInstance();
+	Image* current = images->getCurrentImage();
+	ViewTransform view = images->getViewTransform();
+	view.filter = (ResampleFilter)resampleFilter;
+	for (int i = 0; i < images->getNumberOfImages(); i++) {
+		// Each image keeps its own pixels and takes the edits of the current one
+		Image image = *images->getImageAt(i);
+		image.rotation = current->rotation;
+		image.flipX = current->flipX;
+		image.flipY = current->flipY;
+		image.mod = current->mod;
+		fs::path path = image.imagePath;
+		path.replace_filename(path.stem().string() + BATCH_SAVE_SUFFIX + extensions[type]);
+		images->getSaves()->submit(image, path.string(), type, saveWithTransforms, quality, pngCompression, view);
+	}
+}
+void App::drawSaves()
+{
+	SaveService* saves = ImageManagment::getInstance()->getSaves();
+	std::vector<SaveJobPtr> jobs = saves->getJobs();
+	if (jobs.empty())
+		return;
+	int active = saves->getActiveCount();
+	std::string label = active > 0 ? "Saving " + std::to_string(active) + "###Saves" : "Saves###Saves";
+	if (ImGui::BeginMenu(label.c_str())) {
+		for (SaveJobPtr& job : jobs) {
+			ImGui::PushID(job->id);
+			ImGui::Text("%s", fs::path(job->path).filename().string().c_str());
+			ImGui::SameLine(250);
+			int state = job->state;
+			if (state == SAVE_QUEUED || state == SAVE_RUNNING || state == SAVE_ENCODING) {
+				const char* overlay = job->cancelled ? "Cancelling" : state == SAVE_QUEUED ? "Queued" : state == SAVE_ENCODING ? "Encoding" : nullptr;
+				ImGui::ProgressBar(job->progress, ImVec2(150, 0), overlay);
+				ImGui::SameLine();
+				if (ImGui::SmallButton("Cancel"))
+					saves->cancel(job->id);
+			}
+			else {
+				ImGui::TextDisabled(state == SAVE_DONE ? "Saved" : state == SAVE_FAILED ? "Failed" : "Cancelled");
+			}
+			ImGui::PopID();
+		}
+		if (active < jobs.size()) {
+			ImGui::Separator();
+			if (ImGui::MenuItem("Clear finished"))
+				saves->clearFinished();
+		}
+		ImGui::EndMenu();
+	}
+	// The running save is first in the list
+	if (active > 0)
+		ImGui::ProgressBar(jobs[0]->progress, ImVec2(100, 0));
+}
 void App::generateBufffer()
 {
 	glGenBuffers(1, &buffer);
@@ -9,8 +9,11 @@
 #include "FileDialog.h"
 #include "Shader.h"
 #include "ImageShaderModification.h"
+#include "Benchmark.h"
 
 #define STRIP_DISTANCE 160
+// Added to the file name of each image a batch save writes next to it
+#define BATCH_SAVE_SUFFIX "_edited"
 class App
 {
 public:
@@ -25,6 +28,10 @@ public:
 	static int hoverSel;
 	static bool shouldToggleFullscreen;
 	int quality = 80;
+	int pngCompression = PNG_COMPRESSION_LEVEL;
+	int resampleFilter = RESAMPLE_BICUBIC;
+	bool binTiled = false;
+	bool binCompressed = true;
 
 	App(std::string file, std::string icon) {
 		iconPath = icon;
@@ -41,6 +48,11 @@ public:
 	void drawBoundingBox();
 	void drawImageStrip();
 	void drawMenu();
+	void drawSaves();
+	void queueSave(int type);
+	// The current image's edits and view saved for every open image
+	void queueBatchSave(int type);
+	std::vector<std::string> getBenchmarkImages();
 
 	void toggleFullScreen();
 	void generateBufffer();
@@ -61,6 +73,11 @@ private:
 	bool isFullScreen = false;
 	bool isLight = false;
 	bool saveWithTransforms = true;
+	bool usePixelBuffers = true;
+	int textureCacheMB = TEXTURE_CACHE_BUDGET_MB;
+	int pixelCacheMB = PIXEL_CACHE_BUDGET_MB;
+	int stripBatches = 0;
+	BenchmarkRunner benchmarks;
 };
 void mouseClick(GLFWwindow* window, int button, int action, int mods);
 void keyPressed(GLFWwindow* window, int key, int scancode, int action, int mods);
@@ -0,0 +1,293 @@
+#include "Benchmark.h"
+#include "ImageManagment.h"
+#include "ThreadPool.h"
+#include "HsvKernels.h"
+#include "Orientation.h"
+#include "Warp.h"
+#include <chrono>
+#include <filesystem>
+
+static double now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+BenchmarkRunner::~BenchmarkRunner()
+{
+	stop = true;
+	if (worker.joinable())
+		worker.join();
+}
+
+bool BenchmarkRunner::run(const std::string& title, std::function<std::vector<BenchmarkResult>(const std::atomic<bool>& stop)> benchmark)
+{
+	if (running)
+		return false;
+	if (worker.joinable())
+		worker.join();
+	resultsMutex.lock();
+	this->title = title;
+	results.clear();
+	resultsMutex.unlock();
+	running = true;
+	worker = std::thread([this, benchmark] {
+		std::vector<BenchmarkResult> finished = benchmark(stop);
+		resultsMutex.lock();
+		results = finished;
+		resultsMutex.unlock();
+		running = false;
+	});
+	return true;
+}
+
+std::string BenchmarkRunner::getTitle()
+{
+	std::lock_guard g(resultsMutex);
+	return title;
+}
+
+std::vector<BenchmarkResult> BenchmarkRunner::getResults()
+{
+	std::lock_guard g(resultsMutex);
+	return results;
+}
+
+static size_t fileSize(const std::string& path)
+{
+	std::error_code error;
+	size_t size = std::filesystem::file_size(path, error);
+	return error ? 0 : size;
+}
+
+// Streams the image through a RowWriter the way a save does
+static void writeRows(RowWriter* writer, const std::string& path, ImageData* image)
+{
+	size_t rowBytes = (size_t)image->width * image->channels;
+	if (!writer->begin(path, image->width, image->height, image->channels))
+		return;
+	for (int y = 0; y < image->height; y += SAVE_BAND_ROWS) {
+		writer->writeRows(image->data + y * rowBytes, (std::min)(SAVE_BAND_ROWS, image->height - y));
+	}
+	writer->finish();
+}
+
+// reference writes the image with the stb encoder, type and setting pick the RowWriter it is compared with
+static std::vector<BenchmarkResult> benchmarkEncoders(const std::vector<std::string>& imagePaths, const std::string& extension,
+	BenchmarkResult reference, std::function<void(const char*, ImageData*)> writeReference,
+	BenchmarkResult rows, int type, int setting, const std::atomic<bool>& stop)
+{
+	std::string path = (std::filesystem::temp_directory_path() / ("image-viewer-benchmark" + extension)).string();
+	for (const std::string& imagePath : imagePaths) {
+		if (stop)
+			break;
+		ImageDataPtr image = decodeImage(imagePath);
+		if (!image)
+			continue;
+		double megapixels = (double)image->width * image->height / 1e6;
+
+		double start = now();
+		writeReference(path.c_str(), image.get());
+		reference.seconds += now() - start;
+		reference.megapixels += megapixels;
+		reference.outputBytes += fileSize(path);
+
+		start = now();
+		std::unique_ptr<RowWriter> writer = type == PNG ? createRowWriter(PNG, 0, setting) : createRowWriter(type, setting);
+		writeRows(writer.get(), path, image.get());
+		writer.reset();
+		rows.seconds += now() - start;
+		rows.megapixels += megapixels;
+		rows.outputBytes += fileSize(path);
+	}
+	std::error_code error;
+	std::filesystem::remove(path, error);
+	return { reference, rows };
+}
+
+static std::string threads()
+{
+	return std::to_string(ThreadPool::getInstance()->getThreadCount()) + " threads";
+}
+
+std::vector<BenchmarkResult> benchmarkPngEncoders(const std::vector<std::string>& imagePaths, int compression, const std::atomic<bool>& stop)
+{
+	return benchmarkEncoders(imagePaths, ".png", { "stbi_write_png (level 8, 1 thread)" },
+		[](const char* path, ImageData* image) { stbi_write_png(path, image->width, image->height, image->channels, image->data, image->width * image->channels); },
+		{ "PngRowWriter (level " + std::to_string(compression) + ", " + threads() + ")" }, PNG, compression, stop);
+}
+
+std::vector<BenchmarkResult> benchmarkJpegEncoders(const std::vector<std::string>& imagePaths, int quality, const std::atomic<bool>& stop)
+{
+	return benchmarkEncoders(imagePaths, ".jpg", { "stbi_write_jpg (quality " + std::to_string(quality) + ", 1 thread)" },
+		[quality](const char* path, ImageData* image) { stbi_write_jpg(path, image->width, image->height, image->channels, image->data, quality); },
+		{ "JpegRowWriter (quality " + std::to_string(quality) + ", " + threads() + ")" }, JPG, quality, stop);
+}
+
+// The conversion hsvEdit did before the kernels, a pixel at a time, kept apart from them as the reference they are checked against
+static void hsvEditReference(int pixels, unsigned char* data, float hue, float saturation, float value)
+{
+	for (int i = 0; i < pixels; i++, data += 3) {
+		float r = data[0] / 255.0f, g = data[1] / 255.0f, b = data[2] / 255.0f;
+		float h = 0, s = 0, v = 0;
+		RGBtoHSV(r, g, b, h, s, v);
+		h += hue;
+		h = h > 360.0 ? h - 360.0 : h;
+		s = (std::min)(s * saturation, 1.0f);
+		v = (std::min)(v * value, 1.0f);
+		HSVtoRGB(r, g, b, h, s, v);
+		data[0] = (unsigned char)(r * 255.0f);
+		data[1] = (unsigned char)(g * 255.0f);
+		data[2] = (unsigned char)(b * 255.0f);
+	}
+}
+
+std::vector<BenchmarkResult> benchmarkHsvKernels(const std::atomic<bool>& stop)
+{
+	const int size = 4096;
+	std::vector<unsigned char> colours((size_t)size * size * 3);
+	for (size_t i = 0; i < (size_t)size * size; i++) {
+		colours[i * 3] = i & 0xff;
+		colours[i * 3 + 1] = (i >> 8) & 0xff;
+		colours[i * 3 + 2] = (i >> 16) & 0xff;
+	}
+	const float settings[2][3] = { { 120.0f, 1.5f, 0.8f }, { 0.0f, 1.0f, 1.0f } };
+	std::vector<BenchmarkResult> results;
+	std::vector<unsigned char> reference, edited;
+	for (const float* setting : settings) {
+		char params[64];
+		snprintf(params, sizeof(params), "hue %.0f, saturation %.1f, value %.1f", setting[0], setting[1], setting[2]);
+		reference = colours;
+		hsvEditReference(size * size, reference.data(), setting[0], setting[1], setting[2]);
+		for (int kernel = HSV_KERNEL_SCALAR; kernel < HSV_KERNEL_COUNT && !stop; kernel++) {
+			if (!hsvKernelSupported((HsvKernel)kernel))
+				continue;
+			edited = colours;
+			double start = now();
+			hsvEditWith((HsvKernel)kernel, size, size, edited.data(), setting[0], setting[1], setting[2], 3);
+			BenchmarkResult result = { std::string(hsvKernelName((HsvKernel)kernel)) + " (" + params + ")" };
+			result.seconds = now() - start;
+			result.megapixels = (double)size * size / 1e6;
+			int maxDifference = 0;
+			size_t differing = 0;
+			for (size_t i = 0; i < edited.size(); i++) {
+				int difference = abs((int)edited[i] - (int)reference[i]);
+				maxDifference = (std::max)(maxDifference, difference);
+				differing += difference != 0;
+			}
+			result.failed = maxDifference > HSV_KERNEL_TOLERANCE;
+			result.name += ", max difference " + std::to_string(maxDifference) + " in " + std::to_string(differing) + " channels";
+			results.push_back(result);
+		}
+	}
+	return results;
+}
+
+std::vector<BenchmarkResult> benchmarkOrientations(const std::atomic<bool>& stop)
+{
+	const int size = BENCHMARK_ORIENT_SIZE;
+	ThreadPool* pool = ThreadPool::getInstance();
+	std::vector<BenchmarkResult> results;
+	for (int channels = 3; channels <= 4 && !stop; channels++) {
+		size_t bytes = (size_t)size * size * channels;
+		std::vector<unsigned char> src(bytes), dst(bytes);
+		for (size_t i = 0; i < bytes; i++)
+			src[i] = (unsigned char)(i * 31 + (i >> 12));
+		std::string suffix = " (" + std::to_string(channels) + " channels, " + threads() + ")";
+
+		// The bound the orientations should come close to, the same bytes copied in as many bands
+		int bands = pool->getThreadCount() * 4;
+		size_t bandBytes = (bytes + bands - 1) / bands;
+		double start = now();
+		pool->parallelFor(bands, [&](int band) {
+			size_t first = band * bandBytes;
+			if (first < bytes)
+				memcpy(dst.data() + first, src.data() + first, (std::min)(bandBytes, bytes - first));
+		});
+		results.push_back({ "memcpy" + suffix, now() - start, (double)size * size / 1e6, bytes });
+
+		for (int orientation = ORIENT_FLIP_X; orientation < ORIENT_COUNT && !stop; orientation++) {
+			start = now();
+			orientData((Orientation)orientation, size, size, src.data(), dst.data(), channels);
+			results.push_back({ orientationName((Orientation)orientation) + suffix, now() - start, (double)size * size / 1e6, bytes });
+		}
+	}
+	return results;
+}
+
+// The flips as they were before the row and shuffle versions, kept to measure against
+static void swapFlipX(int width, int height, unsigned char* data, int channels)
+{
+	for (int y = 0; y < height; y++) {
+		for (int i = 0; i < width / 2; i++) {
+			for (int c = 0; c < channels; c++)
+				std::swap(data[y * width * channels + i * channels + c], data[y * width * channels + (width - i - 1) * channels + c]);
+		}
+	}
+}
+
+static void swapFlipY(int width, int height, unsigned char* data, int channels)
+{
+	for (int y = 0; y < height / 2; y++) {
+		for (int x = 0; x < width; x++) {
+			for (int i = 0; i < channels; i++)
+				std::swap(data[(y * width + x) * channels + i], data[((height - y - 1) * width + x) * channels + i]);
+		}
+	}
+}
+
+std::vector<BenchmarkResult> benchmarkFlips(const std::atomic<bool>& stop)
+{
+	const int size = BENCHMARK_FLIP_SIZE;
+	const std::pair<const char*, void(*)(int, int, unsigned char*, int)> flips[4] = {
+		{ "Per channel flip X", swapFlipX }, { "flipDataX", flipDataX }, { "Per channel flip Y", swapFlipY }, { "flipDataY", flipDataY }
+	};
+	std::vector<BenchmarkResult> results;
+	for (int channels : { 1, 3, 4 }) {
+		std::vector<unsigned char> data((size_t)size * size * channels);
+		for (size_t i = 0; i < data.size(); i++)
+			data[i] = (unsigned char)(i * 7);
+		for (const auto& flip : flips) {
+			if (stop)
+				return results;
+			double start = now();
+			flip.second(size, size, data.data(), channels);
+			results.push_back({ flip.first + std::string(" (") + std::to_string(channels) + " channels)", now() - start, (double)size * size / 1e6, data.size() });
+		}
+	}
+	return results;
+}
+
+std::vector<BenchmarkResult> benchmarkWarpFilters(const std::atomic<bool>& stop)
+{
+	const int size = BENCHMARK_WARP_SIZE;
+	ImageData source(new unsigned char[(size_t)size * size * 4], size, size, 4, [](unsigned char* data) { delete[] data; });
+	for (size_t i = 0; i < source.size(); i++)
+		source.data[i] = (unsigned char)(i * 13 + (i >> 14));
+	std::vector<unsigned char> out(source.size());
+
+	// Rotated around the center, the corners of the output fall outside the source
+	const double angle = 3.14159265358979323846 / 6;
+	WarpMap map;
+	map.mapX[0] = cos(angle);
+	map.mapX[1] = -sin(angle);
+	map.mapY[0] = sin(angle);
+	map.mapY[1] = cos(angle);
+	map.mapX[2] = size / 2.0 - (map.mapX[0] + map.mapX[1]) * (size / 2.0 - 0.5);
+	map.mapY[2] = size / 2.0 - (map.mapY[0] + map.mapY[1]) * (size / 2.0 - 0.5);
+
+	std::vector<BenchmarkResult> results;
+	ThreadPool* pool = ThreadPool::getInstance();
+	for (int filter = RESAMPLE_NEAREST; filter < RESAMPLE_COUNT && !stop; filter++) {
+		double start = now();
+		warpRows(source, map, (ResampleFilter)filter, size, 0, size, out.data());
+		results.push_back({ resampleFilterName((ResampleFilter)filter) + std::string(" (1 thread)"), now() - start, (double)size * size / 1e6 });
+
+		start = now();
+		pool->parallelFor((size + SAVE_FUSED_ROWS - 1) / SAVE_FUSED_ROWS, [&](int group) {
+			int row = group * SAVE_FUSED_ROWS;
+			warpRows(source, map, (ResampleFilter)filter, size, row, (std::min)(SAVE_FUSED_ROWS, size - row), out.data() + (size_t)row * size * 4);
+		});
+		results.push_back({ resampleFilterName((ResampleFilter)filter) + (" (" + threads() + ")"), now() - start, (double)size * size / 1e6 });
+	}
+	return results;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <functional>
+
+// How many images of the open folder a benchmark runs on
+#define BENCHMARK_MAX_IMAGES 8
+// Side of the synthetic image the orientation benchmark rotates, 100 MP
+#define BENCHMARK_ORIENT_SIZE 10000
+// Side of the synthetic image flipped in place, 16 MP
+#define BENCHMARK_FLIP_SIZE 4096
+// Side of the synthetic image and of the rotated view the resampling benchmark renders, 16 MP
+#define BENCHMARK_WARP_SIZE 4096
+
+struct BenchmarkResult {
+	std::string name;
+	double seconds = 0;
+	double megapixels = 0;		// pixels processed in total
+	size_t outputBytes = 0;		// 0 when nothing is written
+	bool failed = false;		// the output didn't pass the benchmark's correctness check
+};
+
+// Runs one benchmark at a time on its own thread, the Statistics menu shows the last results
+class BenchmarkRunner
+{
+public:
+	~BenchmarkRunner();
+
+	// false while a benchmark is still running. The benchmark should return early once stop is set.
+	bool run(const std::string& title, std::function<std::vector<BenchmarkResult>(const std::atomic<bool>& stop)> benchmark);
+	bool isRunning() { return running; }
+	std::string getTitle();
+	std::vector<BenchmarkResult> getResults();
+private:
+	std::thread worker;
+	std::mutex resultsMutex;
+	std::string title;
+	std::vector<BenchmarkResult> results;
+	std::atomic<bool> running = false;
+	std::atomic<bool> stop = false;
+};
+
+// stbi_write_png against the parallel PngRowWriter at the given zlib level, both writing to a temporary file
+std::vector<BenchmarkResult> benchmarkPngEncoders(const std::vector<std::string>& imagePaths, int compression, const std::atomic<bool>& stop);
+// stbi_write_jpg against the parallel JpegRowWriter at the same quality
+std::vector<BenchmarkResult> benchmarkJpegEncoders(const std::vector<std::string>& imagePaths, int quality, const std::atomic<bool>& stop);
+// Every HsvKernel the CPU supports on a synthetic image holding all 2^24 colours. Each one, the scalar kernel included,
+// fails when it is more than HSV_KERNEL_TOLERANCE off the per pixel RGBtoHSV / HSVtoRGB conversion hsvEdit used to do.
+std::vector<BenchmarkResult> benchmarkHsvKernels(const std::atomic<bool>& stop);
+// orientData for every orientation on a synthetic RGB and RGBA image, next to a memcpy of the same bytes on the same threads
+std::vector<BenchmarkResult> benchmarkOrientations(const std::atomic<bool>& stop);
+// flipDataX and flipDataY against the per channel swaps they replaced, on synthetic images of 1, 3 and 4 channels
+std::vector<BenchmarkResult> benchmarkFlips(const std::atomic<bool>& stop);
+// Every resampling filter rotating a synthetic RGBA image by 30 degrees, on one thread and on the ThreadPool
+std::vector<BenchmarkResult> benchmarkWarpFilters(const std::atomic<bool>& stop);
@@ -0,0 +1,166 @@
+#include "BinFormat.h"
+#include <fstream>
+#include <cstring>
+#ifdef HAS_ZLIB
+#include <zlib.h>
+#endif
+
+#define BIN_TILED_HEADER_SIZE 40
+
+bool check_bin_tiled_header(const unsigned char* header, unsigned long long fileSize)
+{
+	if (fileSize < BIN_TILED_HEADER_SIZE)
+		return false;
+	unsigned int fields[6];
+	memcpy(fields, header, 24);
+	unsigned int width = fields[0], height = fields[1], type = fields[2], channels = fields[3], compression = fields[4], len = fields[5];
+	return type == BIN_TYPE_TILED && width > 0 && height > 0 && channels >= 1 && channels <= 4
+		&& compression <= BIN_COMPRESSION_DEFLATE && len == (unsigned int)fileSize;
+}
+
+std::shared_ptr<BinTileSource> BinTileSource::open(const std::string& path)
+{
+	std::shared_ptr<MappedFile> file = MappedFile::open(path);
+	if (!file || !check_bin_tiled_header(file->getData(), file->getSize()))
+		return nullptr;
+	unsigned int fields[6], tileSize, levelCount;
+	unsigned long long indexOffset;
+	const unsigned char* header = file->getData();
+	memcpy(fields, header, 24);
+	memcpy(&tileSize, header + 24, 4);
+	memcpy(&levelCount, header + 28, 4);
+	memcpy(&indexOffset, header + 32, 8);
+
+	std::shared_ptr<BinTileSource> source(new BinTileSource());
+	source->file = file;
+	source->width = fields[0];
+	source->height = fields[1];
+	source->channels = fields[3];
+	source->compression = fields[4];
+	if (tileSize != TILE_SIZE || levelCount != levelCountFor(source->width, source->height))
+		return nullptr;
+
+	// Every entry has to point inside the file and hold a whole tile.
+	// The offsets come from the file, so the checks are written so that they can't overflow.
+	unsigned long long position = indexOffset;
+	const unsigned long long fileSize = file->getSize();
+	for (int level = 0; level < levelCount; level++) {
+		int columns = (source->getLevelWidth(level) + TILE_SIZE - 1) / TILE_SIZE;
+		int rows = (source->getLevelHeight(level) + TILE_SIZE - 1) / TILE_SIZE;
+		std::vector<BinTileEntry> entries(columns * rows);
+		if (position > fileSize || entries.size() * sizeof(BinTileEntry) > fileSize - position)
+			return nullptr;
+		memcpy(entries.data(), header + position, entries.size() * sizeof(BinTileEntry));
+		position += entries.size() * sizeof(BinTileEntry);
+		for (int i = 0; i < entries.size(); i++) {
+			int tileWidth = std::min(TILE_SIZE, source->getLevelWidth(level) - i % columns * TILE_SIZE);
+			int tileHeight = std::min(TILE_SIZE, source->getLevelHeight(level) - i / columns * TILE_SIZE);
+			if (entries[i].rawBytes != (unsigned int)tileWidth * tileHeight * source->channels)
+				return nullptr;
+			if (entries[i].offset > fileSize || entries[i].storedBytes > fileSize - entries[i].offset)
+				return nullptr;
+		}
+		source->index.push_back(entries);
+	}
+	return source;
+}
+
+ImageDataPtr BinTileSource::getTile(int level, int column, int row)
+{
+	int columns = (getLevelWidth(level) + TILE_SIZE - 1) / TILE_SIZE;
+	const BinTileEntry& entry = index[level][row * columns + column];
+	int tileWidth = std::min(TILE_SIZE, getLevelWidth(level) - column * TILE_SIZE);
+	int tileHeight = std::min(TILE_SIZE, getLevelHeight(level) - row * TILE_SIZE);
+	unsigned char* stored = file->getData() + entry.offset;
+	if (entry.storedBytes == entry.rawBytes) {
+		std::shared_ptr<MappedFile> mapped = file;
+		return std::make_shared<ImageData>(stored, tileWidth, tileHeight, channels, [mapped](unsigned char* data) {});
+	}
+#ifdef HAS_ZLIB
+	unsigned char* data = new unsigned char[entry.rawBytes];
+	uLongf length = entry.rawBytes;
+	if (uncompress(data, &length, stored, entry.storedBytes) != Z_OK || length != entry.rawBytes) {
+		delete[] data;
+		return nullptr;
+	}
+	return std::make_shared<ImageData>(data, tileWidth, tileHeight, channels, [](unsigned char* d) { delete[] d; });
+#else
+	return nullptr;
+#endif
+}
+
+ImageDataPtr BinTileSource::getLevel(int level)
+{
+	int levelWidth = getLevelWidth(level), levelHeight = getLevelHeight(level);
+	int columns = (levelWidth + TILE_SIZE - 1) / TILE_SIZE;
+	int rows = (levelHeight + TILE_SIZE - 1) / TILE_SIZE;
+	if (columns == 1 && rows == 1)
+		return getTile(level, 0, 0);
+	unsigned char* data = new unsigned char[(size_t)levelWidth * levelHeight * channels];
+	for (int row = 0; row < rows; row++) {
+		for (int column = 0; column < columns; column++) {
+			ImageDataPtr tile = getTile(level, column, row);
+			if (!tile) {
+				delete[] data;
+				return nullptr;
+			}
+			size_t tileStride = (size_t)tile->width * channels;
+			for (int y = 0; y < tile->height; y++)
+				memcpy(data + ((size_t)(row * TILE_SIZE + y) * levelWidth + column * TILE_SIZE) * channels, tile->data + y * tileStride, tileStride);
+		}
+	}
+	return std::make_shared<ImageData>(data, levelWidth, levelHeight, channels, [](unsigned char* d) { delete[] d; });
+}
+
+bool write_bin_tiled(const char* path, int width, int height, int channels, unsigned char* data, bool compress)
+{
+	std::ofstream writer(path, std::ios::out | std::ios::binary);
+	if (!writer.is_open())
+		return false;
+#ifndef HAS_ZLIB
+	compress = false;
+#endif
+	PyramidTileSource pyramid(std::make_shared<ImageData>(data, width, height, channels, nullptr));
+	unsigned int fields[8] = { (unsigned int)width, (unsigned int)height, BIN_TYPE_TILED, (unsigned int)channels,
+		(unsigned int)(compress ? BIN_COMPRESSION_DEFLATE : BIN_COMPRESSION_NONE), 0, TILE_SIZE, (unsigned int)pyramid.getLevelCount() };
+	unsigned long long indexOffset = 0;
+	writer.write((char*)fields, sizeof(fields));
+	writer.write((char*)&indexOffset, sizeof(indexOffset));
+
+	std::vector<BinTileEntry> entries;
+	std::vector<unsigned char> compressed;
+	for (int level = 0; level < pyramid.getLevelCount(); level++) {
+		int columns = (pyramid.getLevelWidth(level) + TILE_SIZE - 1) / TILE_SIZE;
+		int rows = (pyramid.getLevelHeight(level) + TILE_SIZE - 1) / TILE_SIZE;
+		for (int row = 0; row < rows; row++) {
+			for (int column = 0; column < columns; column++) {
+				ImageDataPtr tile = pyramid.getTile(level, column, row);
+				BinTileEntry entry;
+				entry.offset = writer.tellp();
+				entry.rawBytes = entry.storedBytes = tile->size();
+				const unsigned char* stored = tile->data;
+#ifdef HAS_ZLIB
+				if (compress) {
+					uLongf length = compressBound(entry.rawBytes);
+					compressed.resize(length);
+					if (compress2(compressed.data(), &length, tile->data, entry.rawBytes, Z_DEFAULT_COMPRESSION) == Z_OK && length < entry.rawBytes) {
+						entry.storedBytes = length;
+						stored = compressed.data();
+					}
+				}
+#endif
+				writer.write((char*)stored, entry.storedBytes);
+				entries.push_back(entry);
+			}
+		}
+	}
+	indexOffset = writer.tellp();
+	writer.write((char*)entries.data(), entries.size() * sizeof(BinTileEntry));
+	unsigned int len = (unsigned int)(unsigned long long)writer.tellp();
+	writer.seekp(20);
+	writer.write((char*)&len, sizeof(len));
+	writer.seekp(32);
+	writer.write((char*)&indexOffset, sizeof(indexOffset));
+	writer.close();
+	return !writer.fail();
+}
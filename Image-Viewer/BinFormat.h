@@ -0,0 +1,57 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include "TileSource.h"
+#include "MappedFile.h"
+
+#if __has_include(<zlib.h>)
+#define HAS_ZLIB 1
+#endif
+
+// Values of the type field of the .bin header
+#define BIN_TYPE_FLAT 0
+#define BIN_TYPE_TILED 2
+// Values of the xor field for tiled files
+#define BIN_COMPRESSION_NONE 0
+#define BIN_COMPRESSION_DEFLATE 1
+
+// Tiled .bin (v2), the 24 byte header is the same as in the flat format :
+//	resolution x, resolution y, type (2), channels, compression (in the xor field), len (file size, low 32 bits)
+// followed by
+//	tile size(4 bytes), level count(4 bytes), index offset(8 bytes)
+// and the tiles of every level, level 0 is the full resolution and each next one half of it.
+// The index lists every tile of level 0 row by row, then level 1 ... as offset(8 bytes), stored size(4 bytes),
+// raw size(4 bytes). A tile is stored compressed only when that made it smaller, stored size is the raw size otherwise.
+struct BinTileEntry {
+	unsigned long long offset = 0;
+	unsigned int storedBytes = 0;
+	unsigned int rawBytes = 0;
+};
+
+static_assert(sizeof(BinTileEntry) == 16, "BinTileEntry is written as is");
+
+class BinTileSource : public TileSource
+{
+public:
+	// nullptr when the file isn't a valid tiled .bin
+	static std::shared_ptr<BinTileSource> open(const std::string& path);
+
+	int getWidth() override { return width; }
+	int getHeight() override { return height; }
+	int getChannels() override { return channels; }
+	int getLevelCount() override { return index.size(); }
+	// Uncompressed tiles point into the mapped file
+	ImageDataPtr getTile(int level, int column, int row) override;
+	size_t getResidentBytes() override { return 0; }
+	ImageDataPtr getLevel(int level) override;
+private:
+	BinTileSource() = default;
+
+	std::shared_ptr<MappedFile> file;
+	int width = 0, height = 0, channels = 0, compression = BIN_COMPRESSION_NONE;
+	std::vector<std::vector<BinTileEntry>> index;
+};
+
+bool check_bin_tiled_header(const unsigned char* header, unsigned long long fileSize);
+bool write_bin_tiled(const char* path, int width, int height, int channels, unsigned char* data, bool compress);
@@ -0,0 +1,50 @@
+#include "CpuFeatures.h"
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+bool cpuHasSsse3()
+{
+#if !defined(HAS_X86_SIMD)
+	return false;
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 9)) != 0;
+#else
+	return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+bool cpuHasSse41()
+{
+#if !defined(HAS_X86_SIMD)
+	return false;
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 19)) != 0;
+#else
+	return __builtin_cpu_supports("sse4.1");
+#endif
+}
+
+bool cpuHasAvx2()
+{
+#if !defined(HAS_X86_SIMD)
+	return false;
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	// The OS has to save the ymm registers too
+	__cpuid(info, 1);
+	if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6)
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define HAS_X86_SIMD 1
+#include <immintrin.h>
+// MSVC compiles any intrinsic anywhere, GCC and Clang need the function marked for the instruction set it uses
+#ifdef _MSC_VER
+#define TARGET_SSSE3
+#define TARGET_SSE41
+#define TARGET_AVX2
+#else
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// What the CPU running the app supports, false everywhere but x86
+bool cpuHasSsse3();
+bool cpuHasSse41();
+bool cpuHasAvx2();
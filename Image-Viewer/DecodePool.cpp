@@ -0,0 +1,141 @@
+#include "DecodePool.h"
+#include "ImageManagment.h"
+#include <algorithm>
+#include <cstdlib>
+
+DecodePool::DecodePool(std::function<void(DecodeJob, ImageDataPtr)> onDecoded, unsigned int threadCount)
+{
+	this->onDecoded = onDecoded;
+	if (threadCount == 0)
+		threadCount = std::thread::hardware_concurrency();
+	if (threadCount == 0)
+		threadCount = 1;
+	for (unsigned int i = 0; i < threadCount; i++) {
+		workers.emplace_back(&DecodePool::runWorker, this);
+	}
+}
+
+DecodePool::~DecodePool()
+{
+	stop();
+}
+
+void DecodePool::submit(DecodeJob job)
+{
+	jobsMutex.lock();
+	job.generation = generation;
+	jobs.push_back(job);
+	jobsMutex.unlock();
+	jobsCondition.notify_one();
+}
+
+void DecodePool::followUp(DecodeJob job)
+{
+	jobsMutex.lock();
+	bool stale = isStale(job);
+	if (stale)
+		droppedJobs++;
+	else
+		jobs.push_back(job);
+	jobsMutex.unlock();
+	if (stale)
+		onDecoded(job, nullptr);
+	else
+		jobsCondition.notify_one();
+}
+
+void DecodePool::retarget(int selectedIndex, int radius, unsigned int folderGeneration)
+{
+	std::vector<DecodeJob> dropped;
+	jobsMutex.lock();
+	generation++;
+	this->selectedIndex = selectedIndex;
+	this->radius = radius;
+	this->folderGeneration = folderGeneration;
+	dropStaleJobs(dropped);
+	jobsMutex.unlock();
+
+	for (DecodeJob& job : dropped) {
+		onDecoded(job, nullptr);
+	}
+}
+
+bool DecodePool::isStale(const DecodeJob& job)
+{
+	if (job.generation == generation)
+		return false;
+	return job.folderGeneration != folderGeneration || abs(job.index - selectedIndex) > radius;
+}
+
+void DecodePool::dropStaleJobs(std::vector<DecodeJob>& dropped)
+{
+	auto stale = std::stable_partition(jobs.begin(), jobs.end(), [this](const DecodeJob& job) { return !isStale(job); });
+	dropped.insert(dropped.end(), stale, jobs.end());
+	droppedJobs += jobs.end() - stale;
+	jobs.erase(stale, jobs.end());
+}
+
+void DecodePool::stop()
+{
+	jobsMutex.lock();
+	running = false;
+	jobs.clear();
+	jobsMutex.unlock();
+	jobsCondition.notify_all();
+	for (auto& t : workers) {
+		if (t.joinable())
+			t.join();
+	}
+	workers.clear();
+}
+
+int DecodePool::getPendingJobs()
+{
+	std::lock_guard g(jobsMutex);
+	return jobs.size();
+}
+
+int DecodePool::getActiveJobs()
+{
+	std::lock_guard g(jobsMutex);
+	return activeJobs;
+}
+
+void DecodePool::runWorker()
+{
+	while (true) {
+		std::unique_lock lock(jobsMutex);
+		jobsCondition.wait(lock, [this] { return !jobs.empty() || !running; });
+		if (!running)
+			return;
+
+		// Jobs from older generations are ranked by their distance to the current selection,
+		// the closest image goes first and ties keep the submit order
+		for (DecodeJob& job : jobs) {
+			if (job.generation != generation)
+				job.priority = abs(job.index - selectedIndex);
+		}
+		auto best = jobs.begin();
+		for (auto it = jobs.begin(); it != jobs.end(); it++) {
+			if (it->priority < best->priority)
+				best = it;
+		}
+		DecodeJob job = *best;
+		jobs.erase(best);
+		activeJobs++;
+		lock.unlock();
+
+		ImageDataPtr data = decodeImage(job.imagePath, job.maxWidth, job.maxHeight, &job.fullWidth, &job.fullHeight, &job.tileSource);
+
+		// The selection may have moved on while decoding, there is nothing to upload then
+		lock.lock();
+		bool stale = isStale(job);
+		if (stale)
+			droppedJobs++;
+		lock.unlock();
+		onDecoded(job, stale ? nullptr : data);
+
+		lock.lock();
+		activeJobs--;
+	}
+}
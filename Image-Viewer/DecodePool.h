@@ -0,0 +1,60 @@
+#pragma once
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <string>
+#include <functional>
+#include "ImageData.h"
+#include "TileSource.h"
+
+struct DecodeJob {
+	int index = -1;
+	std::string imagePath;
+	int priority = 0;					// lower is decoded first (distance from the selected image)
+	unsigned int folderGeneration = 0;	// folder generation the index belongs to
+	unsigned int generation = 0;		// selection generation the job was submitted in, set by the pool
+	int maxWidth = 0, maxHeight = 0;	// decode at a reduced scale covering this size if the format allows it, 0 for full
+	int fullWidth = 0, fullHeight = 0;	// size of the image at full scale, set by the pool
+	std::shared_ptr<TileSource> tileSource;	// set by the pool for files with their own pyramid, the pixels are its coarsest level
+};
+
+// Decodes images on a pool of worker threads, the finished pixels are handed to onDecoded.
+// Every retarget starts a new generation, jobs from older generations are re-prioritized against
+// the new selection and dropped (handed to onDecoded without pixels) once they fall out of its window.
+class DecodePool
+{
+public:
+	DecodePool(std::function<void(DecodeJob, ImageDataPtr)> onDecoded, unsigned int threadCount = 0);
+	~DecodePool();
+
+	void submit(DecodeJob job);
+	// Another pass of an already decoded job, it keeps the job's generation so it is dropped the same way
+	void followUp(DecodeJob job);
+	void retarget(int selectedIndex, int radius, unsigned int folderGeneration);
+	void stop();
+
+	int getPendingJobs();
+	int getActiveJobs();
+	unsigned int getThreadCount() { return workers.size(); }
+	unsigned int getGeneration() { return generation; }
+	unsigned int getDroppedJobs() { return droppedJobs; }
+private:
+	void runWorker();
+	bool isStale(const DecodeJob& job);
+	void dropStaleJobs(std::vector<DecodeJob>& dropped);
+
+	std::function<void(DecodeJob, ImageDataPtr)> onDecoded;
+	std::vector<std::thread> workers;
+	std::vector<DecodeJob> jobs;
+	std::mutex jobsMutex;
+	std::condition_variable jobsCondition;
+	int activeJobs = 0;
+	bool running = true;
+
+	unsigned int generation = 0;
+	unsigned int droppedJobs = 0;
+	int selectedIndex = 0;
+	int radius = 0;
+	unsigned int folderGeneration = 0;
+};
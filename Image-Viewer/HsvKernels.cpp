@@ -0,0 +1,193 @@
+#include "HsvKernels.h"
+#include "ImageManagment.h"
+
+static void hsvEditScalar(int width, int height, unsigned char* data, float hue, float saturation, float value, int channels)
+{
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			unsigned char* pixel = data + y * width * channels + x * channels;
+
+			float r = ((float)pixel[0]) / 255.0f;
+			float g = ((float)pixel[1]) / 255.0f;
+			float b = ((float)pixel[2]) / 255.0f;
+			float h = 0, s = 0, v = 0;
+
+			RGBtoHSV(r, g, b, h, s, v);
+
+			h += hue;
+			h = h > 360.0 ? h - 360.0 : h;
+			s *= saturation;
+			s = s > 1.0 ? 1.0 : s;
+			v *= value;
+			v = v > 1.0 ? 1.0 : v;
+
+			HSVtoRGB(r, g, b, h, s, v);
+
+			pixel[0] = (unsigned char)(r * 255.0f);
+			pixel[1] = (unsigned char)(g * 255.0f);
+			pixel[2] = (unsigned char)(b * 255.0f);
+		}
+	}
+}
+
+#ifdef HAS_X86_SIMD
+// The vector kernels work on planar floats, a chunk of a row is split into r, g and b and merged back after
+struct HsvChunk {
+	alignas(32) float r[HSV_KERNEL_CHUNK];
+	alignas(32) float g[HSV_KERNEL_CHUNK];
+	alignas(32) float b[HSV_KERNEL_CHUNK];
+};
+
+static void loadChunk(HsvChunk& chunk, const unsigned char* pixels, int count, int channels)
+{
+	const float scale = 1.0f / 255.0f;
+	for (int i = 0; i < count; i++, pixels += channels) {
+		chunk.r[i] = pixels[0] * scale;
+		chunk.g[i] = pixels[1] * scale;
+		chunk.b[i] = pixels[2] * scale;
+	}
+}
+
+static void storeChunk(const HsvChunk& chunk, unsigned char* pixels, int count, int channels)
+{
+	// The kernels leave the channels as truncated 0 - 255 values
+	for (int i = 0; i < count; i++, pixels += channels) {
+		pixels[0] = (unsigned char)chunk.r[i];
+		pixels[1] = (unsigned char)chunk.g[i];
+		pixels[2] = (unsigned char)chunk.b[i];
+	}
+}
+
+// Hue in sixths of the circle. RGB to HSV picks the sector by the largest channel, red first like RGBtoHSV,
+// HSV to RGB uses channel = v - v * s * clamp(min(k, 4 - k), 0, 1) with k = (n + h) mod 6 and n = 5, 3, 1 for r, g, b.
+TARGET_SSE41 static void hsvChunkSse41(HsvChunk& chunk, int count, float hue, float saturation, float value)
+{
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f), four = _mm_set1_ps(4.0f), six = _mm_set1_ps(6.0f);
+	const __m128 hueShift = _mm_set1_ps(hue / 60.0f), saturationScale = _mm_set1_ps(saturation), valueScale = _mm_set1_ps(value);
+	const __m128 toByte = _mm_set1_ps(255.0f);
+	const __m128 offsets[3] = { _mm_set1_ps(5.0f), _mm_set1_ps(3.0f), _mm_set1_ps(1.0f) };
+	for (int i = 0; i < count; i += 4) {
+		__m128 r = _mm_load_ps(chunk.r + i), g = _mm_load_ps(chunk.g + i), b = _mm_load_ps(chunk.b + i);
+		__m128 maximum = _mm_max_ps(_mm_max_ps(r, g), b);
+		__m128 minimum = _mm_min_ps(_mm_min_ps(r, g), b);
+		__m128 delta = _mm_sub_ps(maximum, minimum);
+		__m128 colored = _mm_cmpgt_ps(delta, zero);
+		__m128 inverse = _mm_div_ps(one, _mm_blendv_ps(one, delta, colored));
+
+		__m128 hr = _mm_mul_ps(_mm_sub_ps(g, b), inverse);
+		hr = _mm_add_ps(hr, _mm_and_ps(_mm_cmplt_ps(g, b), six));
+		__m128 hg = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(b, r), inverse), two);
+		__m128 hb = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(r, g), inverse), four);
+		__m128 h = _mm_blendv_ps(hb, hg, _mm_cmpeq_ps(maximum, g));
+		h = _mm_blendv_ps(h, hr, _mm_cmpeq_ps(maximum, r));
+		h = _mm_and_ps(h, colored);
+		__m128 s = _mm_and_ps(_mm_mul_ps(delta, _mm_div_ps(one, _mm_blendv_ps(one, maximum, colored))), colored);
+
+		h = _mm_add_ps(h, hueShift);
+		h = _mm_sub_ps(h, _mm_and_ps(_mm_cmpgt_ps(h, six), six));
+		s = _mm_min_ps(_mm_mul_ps(s, saturationScale), one);
+		__m128 v = _mm_min_ps(_mm_mul_ps(maximum, valueScale), one);
+		__m128 chroma = _mm_mul_ps(v, s);
+
+		float* out[3] = { chunk.r + i, chunk.g + i, chunk.b + i };
+		for (int c = 0; c < 3; c++) {
+			__m128 k = _mm_add_ps(offsets[c], h);
+			k = _mm_sub_ps(k, _mm_and_ps(_mm_cmpge_ps(k, six), six));
+			__m128 t = _mm_max_ps(_mm_min_ps(_mm_min_ps(k, _mm_sub_ps(four, k)), one), zero);
+			_mm_store_ps(out[c], _mm_floor_ps(_mm_mul_ps(_mm_sub_ps(v, _mm_mul_ps(chroma, t)), toByte)));
+		}
+	}
+}
+
+TARGET_AVX2 static void hsvChunkAvx2(HsvChunk& chunk, int count, float hue, float saturation, float value)
+{
+	const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), two = _mm256_set1_ps(2.0f), four = _mm256_set1_ps(4.0f), six = _mm256_set1_ps(6.0f);
+	const __m256 hueShift = _mm256_set1_ps(hue / 60.0f), saturationScale = _mm256_set1_ps(saturation), valueScale = _mm256_set1_ps(value);
+	const __m256 toByte = _mm256_set1_ps(255.0f);
+	const __m256 offsets[3] = { _mm256_set1_ps(5.0f), _mm256_set1_ps(3.0f), _mm256_set1_ps(1.0f) };
+	for (int i = 0; i < count; i += 8) {
+		__m256 r = _mm256_load_ps(chunk.r + i), g = _mm256_load_ps(chunk.g + i), b = _mm256_load_ps(chunk.b + i);
+		__m256 maximum = _mm256_max_ps(_mm256_max_ps(r, g), b);
+		__m256 minimum = _mm256_min_ps(_mm256_min_ps(r, g), b);
+		__m256 delta = _mm256_sub_ps(maximum, minimum);
+		__m256 colored = _mm256_cmp_ps(delta, zero, _CMP_GT_OQ);
+		__m256 inverse = _mm256_div_ps(one, _mm256_blendv_ps(one, delta, colored));
+
+		__m256 hr = _mm256_mul_ps(_mm256_sub_ps(g, b), inverse);
+		hr = _mm256_add_ps(hr, _mm256_and_ps(_mm256_cmp_ps(g, b, _CMP_LT_OQ), six));
+		__m256 hg = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(b, r), inverse), two);
+		__m256 hb = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(r, g), inverse), four);
+		__m256 h = _mm256_blendv_ps(hb, hg, _mm256_cmp_ps(maximum, g, _CMP_EQ_OQ));
+		h = _mm256_blendv_ps(h, hr, _mm256_cmp_ps(maximum, r, _CMP_EQ_OQ));
+		h = _mm256_and_ps(h, colored);
+		__m256 s = _mm256_and_ps(_mm256_mul_ps(delta, _mm256_div_ps(one, _mm256_blendv_ps(one, maximum, colored))), colored);
+
+		h = _mm256_add_ps(h, hueShift);
+		h = _mm256_sub_ps(h, _mm256_and_ps(_mm256_cmp_ps(h, six, _CMP_GT_OQ), six));
+		s = _mm256_min_ps(_mm256_mul_ps(s, saturationScale), one);
+		__m256 v = _mm256_min_ps(_mm256_mul_ps(maximum, valueScale), one);
+		__m256 chroma = _mm256_mul_ps(v, s);
+
+		float* out[3] = { chunk.r + i, chunk.g + i, chunk.b + i };
+		for (int c = 0; c < 3; c++) {
+			__m256 k = _mm256_add_ps(offsets[c], h);
+			k = _mm256_sub_ps(k, _mm256_and_ps(_mm256_cmp_ps(k, six, _CMP_GE_OQ), six));
+			__m256 t = _mm256_max_ps(_mm256_min_ps(_mm256_min_ps(k, _mm256_sub_ps(four, k)), one), zero);
+			_mm256_store_ps(out[c], _mm256_floor_ps(_mm256_mul_ps(_mm256_sub_ps(v, _mm256_mul_ps(chroma, t)), toByte)));
+		}
+	}
+}
+#endif
+
+bool hsvKernelSupported(HsvKernel kernel)
+{
+	switch (kernel)
+	{
+	case HSV_KERNEL_SCALAR:
+		return true;
+#ifdef HAS_X86_SIMD
+	case HSV_KERNEL_SSE41:
+		return cpuHasSse41();
+	case HSV_KERNEL_AVX2:
+		return cpuHasAvx2();
+#endif
+	default:
+		return false;
+	}
+}
+
+HsvKernel hsvBestKernel()
+{
+	static HsvKernel best = hsvKernelSupported(HSV_KERNEL_AVX2) ? HSV_KERNEL_AVX2 : hsvKernelSupported(HSV_KERNEL_SSE41) ? HSV_KERNEL_SSE41 : HSV_KERNEL_SCALAR;
+	return best;
+}
+
+const char* hsvKernelName(HsvKernel kernel)
+{
+	const char* names[HSV_KERNEL_COUNT] = { "Scalar", "SSE4.1", "AVX2" };
+	return kernel < HSV_KERNEL_COUNT ? names[kernel] : "";
+}
+
+void hsvEditWith(HsvKernel kernel, int width, int height, unsigned char* data, float hue, float saturation, float value, int channels)
+{
+#ifdef HAS_X86_SIMD
+	if (kernel == HSV_KERNEL_SSE41 || kernel == HSV_KERNEL_AVX2) {
+		HsvChunk chunk;
+		size_t pixels = (size_t)width * height;
+		for (size_t first = 0; first < pixels; first += HSV_KERNEL_CHUNK) {
+			int count = (int)(pixels - first < HSV_KERNEL_CHUNK ? pixels - first : HSV_KERNEL_CHUNK);
+			unsigned char* start = data + first * channels;
+			loadChunk(chunk, start, count, channels);
+			// Rounded up to whole vectors, the extra lanes compute garbage that is never stored
+			int vectorCount = (count + 7) & ~7;
+			if (kernel == HSV_KERNEL_AVX2)
+				hsvChunkAvx2(chunk, vectorCount, hue, saturation, value);
+			else
+				hsvChunkSse41(chunk, vectorCount, hue, saturation, value);
+			storeChunk(chunk, start, count, channels);
+		}
+		return;
+	}
+#endif
+	hsvEditScalar(width, height, data, hue, saturation, value, channels);
+}
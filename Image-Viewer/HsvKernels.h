@@ -0,0 +1,20 @@
+#pragma once
+#include "CpuFeatures.h"
+
+// Pixels converted to planar floats at a time by the vector kernels
+#define HSV_KERNEL_CHUNK 256
+// Most a kernel may differ from the per pixel conversion in any channel
+#define HSV_KERNEL_TOLERANCE 1
+
+enum HsvKernel {
+	HSV_KERNEL_SCALAR = 0, HSV_KERNEL_SSE41, HSV_KERNEL_AVX2, HSV_KERNEL_COUNT
+};
+
+// The fastest kernel the CPU supports, detected once
+HsvKernel hsvBestKernel();
+bool hsvKernelSupported(HsvKernel kernel);
+const char* hsvKernelName(HsvKernel kernel);
+
+// hsvEdit with a specific kernel. The scalar one is the reference, the vector kernels compute the same
+// adjustment branchless on 4 or 8 pixels at a time and may differ from it by HSV_KERNEL_TOLERANCE per channel.
+void hsvEditWith(HsvKernel kernel, int width, int height, unsigned char* data, float hue, float saturation, float value, int channels);
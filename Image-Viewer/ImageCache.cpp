@@ -0,0 +1,143 @@
+#include "ImageCache.h"
+#include "TiledImage.h"
+#include <algorithm>
+#include <cstdlib>
+
+void ImageCache::setBudgets(size_t textureBudget, size_t pixelBudget)
+{
+	std::lock_guard g(cacheMutex);
+	this->textureBudget = textureBudget;
+	this->pixelBudget = pixelBudget;
+}
+
+void ImageCache::clear()
+{
+	std::lock_guard g(cacheMutex);
+	entries.clear();
+	textureBytes = pixelBytes = 0;
+}
+
+void ImageCache::touch(const std::string& path, int index)
+{
+	std::lock_guard g(cacheMutex);
+	CacheEntry& entry = entries[path];
+	entry.index = index;
+	entry.lastUsed = ++tick;
+}
+
+void ImageCache::putPixels(const std::string& path, int index, ImageDataPtr pixels, std::shared_ptr<TiledImage> tiles, size_t bytes, int selectedIndex)
+{
+	std::lock_guard g(cacheMutex);
+	CacheEntry& entry = entries[path];
+	pixelBytes -= entry.pixelBytes;
+	entry.index = index;
+	entry.pixels = pixels;
+	entry.tiles = tiles;
+	entry.pixelBytes = bytes;
+	entry.lastUsed = ++tick;
+	pixelBytes += entry.pixelBytes;
+	evictPixels(selectedIndex);
+}
+
+bool ImageCache::getPixels(const std::string& path, ImageDataPtr& pixels, std::shared_ptr<TiledImage>& tiles)
+{
+	std::lock_guard g(cacheMutex);
+	auto it = entries.find(path);
+	if (it == entries.end() || !it->second.pixels)
+		return false;
+	it->second.lastUsed = ++tick;
+	pixels = it->second.pixels;
+	tiles = it->second.tiles;
+	return true;
+}
+
+ImageDataPtr ImageCache::findFullPixels(const std::string& path)
+{
+	ImageDataPtr pixels;
+	std::shared_ptr<TiledImage> tiles;
+	if (!getPixels(path, pixels, tiles))
+		return nullptr;
+	// A tiled image keeps only its preview as pixels, the full resolution is the first level of its pyramid
+	if (tiles)
+		return tiles->getSource()->getLevel(0);
+	return pixels;
+}
+
+void ImageCache::addTexture(const std::string& path, int index, size_t bytes)
+{
+	std::lock_guard g(cacheMutex);
+	CacheEntry& entry = entries[path];
+	textureBytes += bytes - entry.textureBytes;
+	entry.index = index;
+	entry.textureBytes = bytes;
+	entry.lastUsed = ++tick;
+}
+
+void ImageCache::removeTexture(const std::string& path)
+{
+	std::lock_guard g(cacheMutex);
+	auto it = entries.find(path);
+	if (it == entries.end())
+		return;
+	textureBytes -= it->second.textureBytes;
+	it->second.textureBytes = 0;
+}
+
+void ImageCache::removePixels(const std::string& path)
+{
+	std::lock_guard g(cacheMutex);
+	auto it = entries.find(path);
+	if (it == entries.end())
+		return;
+	pixelBytes -= it->second.pixelBytes;
+	it->second.pixelBytes = 0;
+	it->second.pixels.reset();
+	it->second.tiles.reset();
+}
+
+std::vector<int> ImageCache::textureVictims(int selectedIndex)
+{
+	std::lock_guard g(cacheMutex);
+	std::vector<int> victims;
+	size_t bytes = textureBytes;
+	while (bytes > textureBudget) {
+		CacheEntry* worst = nullptr;
+		for (auto& [path, entry] : entries) {
+			if (entry.textureBytes == 0 || entry.index == selectedIndex)
+				continue;
+			if (std::find(victims.begin(), victims.end(), entry.index) != victims.end())
+				continue;
+			if (worst == nullptr || score(entry, selectedIndex) > score(*worst, selectedIndex))
+				worst = &entry;
+		}
+		if (worst == nullptr)
+			break;
+		victims.push_back(worst->index);
+		bytes -= worst->textureBytes;
+	}
+	return victims;
+}
+
+unsigned long long ImageCache::score(const CacheEntry& entry, int selectedIndex)
+{
+	return (tick - entry.lastUsed) + (unsigned long long)abs(entry.index - selectedIndex) * CACHE_DISTANCE_WEIGHT;
+}
+
+void ImageCache::evictPixels(int selectedIndex)
+{
+	while (pixelBytes > pixelBudget) {
+		CacheEntry* worst = nullptr;
+		for (auto& [path, entry] : entries) {
+			if (!entry.pixels || entry.index == selectedIndex)
+				continue;
+			if (worst == nullptr || score(entry, selectedIndex) > score(*worst, selectedIndex))
+				worst = &entry;
+		}
+		if (worst == nullptr)
+			break;
+		pixelBytes -= worst->pixelBytes;
+		worst->pixels.reset();
+		worst->tiles.reset();
+		worst->pixelBytes = 0;
+	}
+}
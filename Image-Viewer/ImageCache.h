@@ -0,0 +1,69 @@
+#pragma once
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include "ImageData.h"
+
+#define TEXTURE_CACHE_BUDGET_MB 512
+#define PIXEL_CACHE_BUDGET_MB 1024
+// How many ticks of age one image of distance from the selected image is worth when picking what to evict
+#define CACHE_DISTANCE_WEIGHT 4
+
+class TiledImage;
+
+struct CacheEntry {
+	int index = -1;
+	ImageDataPtr pixels;
+	std::shared_ptr<TiledImage> tiles;
+	size_t pixelBytes = 0;
+	size_t textureBytes = 0;
+	unsigned long long lastUsed = 0;
+};
+
+// Keeps textures and decoded pixels of the images in the current folder within a byte budget each.
+// The entry that was used the longest ago and is furthest from the selected image is evicted first.
+class ImageCache
+{
+public:
+	ImageCache(size_t textureBudget = (size_t)TEXTURE_CACHE_BUDGET_MB << 20, size_t pixelBudget = (size_t)PIXEL_CACHE_BUDGET_MB << 20)
+		: textureBudget(textureBudget), pixelBudget(pixelBudget) {
+	}
+
+	void setBudgets(size_t textureBudget, size_t pixelBudget);
+	void clear();
+
+	void touch(const std::string& path, int index);
+	void putPixels(const std::string& path, int index, ImageDataPtr pixels, std::shared_ptr<TiledImage> tiles, size_t bytes, int selectedIndex);
+	bool getPixels(const std::string& path, ImageDataPtr& pixels, std::shared_ptr<TiledImage>& tiles);
+	// Full resolution pixels if they are still cached, shared with the cache so an eviction doesn't free them while in use
+	ImageDataPtr findFullPixels(const std::string& path);
+	void addTexture(const std::string& path, int index, size_t bytes);
+	void removeTexture(const std::string& path);
+	// Forgets the decoded pixels of path, for a file that is about to be replaced
+	void removePixels(const std::string& path);
+	// Images whose textures have to be unloaded to get under the texture budget, never the selected one
+	std::vector<int> textureVictims(int selectedIndex);
+
+	void countTextureHit() { textureHits++; }
+	void countPixelHit() { pixelHits++; }
+	void countMiss() { misses++; }
+	void countReuse() { reuses++; }
+	unsigned int getTextureHits() { return textureHits; }
+	unsigned int getPixelHits() { return pixelHits; }
+	unsigned int getMisses() { return misses; }
+	unsigned int getReuses() { return reuses; }
+	size_t getTextureBytes() { return textureBytes; }
+	size_t getPixelBytes() { return pixelBytes; }
+private:
+	unsigned long long score(const CacheEntry& entry, int selectedIndex);
+	void evictPixels(int selectedIndex);
+
+	std::mutex cacheMutex;
+	std::unordered_map<std::string, CacheEntry> entries;
+	unsigned long long tick = 0;
+	size_t textureBudget, pixelBudget;
+	size_t textureBytes = 0, pixelBytes = 0;
+	unsigned int textureHits = 0, pixelHits = 0, misses = 0, reuses = 0;
+};
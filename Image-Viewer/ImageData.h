@@ -0,0 +1,23 @@
+#pragma once
+#include <functional>
+#include <memory>
+
+// Decoded pixels on the CPU side, released with whatever allocated them (stbi, new[], ...)
+struct ImageData {
+	unsigned char* data = nullptr;
+	int width = 0, height = 0, channels = 0;
+	std::function<void(unsigned char*)> release;
+
+	ImageData(unsigned char* data, int width, int height, int channels, std::function<void(unsigned char*)> release)
+		: data(data), width(width), height(height), channels(channels), release(release) {
+	}
+	ImageData(const ImageData&) = delete;
+	ImageData& operator=(const ImageData&) = delete;
+	~ImageData() {
+		if (data != nullptr && release)
+			release(data);
+	}
+
+	size_t size() const { return (size_t)width * height * channels; }
+};
+typedef std::shared_ptr<ImageData> ImageDataPtr;
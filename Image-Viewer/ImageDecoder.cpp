@@ -0,0 +1,153 @@
+#include "ImageDecoder.h"
+#include "JpegDecoder.h"
+#include "ImageManagment.h"
+#include <algorithm>
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+
+DecoderRegistry* DecoderRegistry::getInstance()
+{
+	static DecoderRegistry registry;
+	return &registry;
+}
+
+DecoderRegistry::DecoderRegistry()
+{
+	// Lowest priority first
+	registerDecoder(std::make_shared<BinDecoder>());
+	registerDecoder(std::make_shared<StbDecoder>());
+	registerDecoder(std::make_shared<JpegDecoder>());
+}
+
+void DecoderRegistry::registerDecoder(std::shared_ptr<ImageDecoder> decoder)
+{
+	std::lock_guard g(decodersMutex);
+	decoders.insert(decoders.begin(), decoder);
+}
+
+bool DecoderRegistry::supportsExtension(std::string extension)
+{
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	std::lock_guard g(decodersMutex);
+	for (auto& decoder : decoders) {
+		std::vector<std::string> extensions = decoder->getExtensions();
+		if (std::find(extensions.begin(), extensions.end(), extension) != extensions.end())
+			return true;
+	}
+	return false;
+}
+
+std::vector<std::shared_ptr<ImageDecoder>> DecoderRegistry::findDecoders(const std::string& imagePath, int capabilities)
+{
+	unsigned char header[DECODER_SNIFF_BYTES] = {};
+	std::ifstream file(imagePath, std::ios::binary);
+	file.read((char*)header, DECODER_SNIFF_BYTES);
+	size_t length = file.gcount();
+	std::error_code error;
+	unsigned long long fileSize = std::filesystem::file_size(imagePath, error);
+	if (error || length == 0)
+		return {};
+
+	std::vector<std::shared_ptr<ImageDecoder>> found;
+	decodersMutex.lock();
+	for (auto& decoder : decoders) {
+		if (decoder->sniff(header, length, fileSize))
+			found.push_back(decoder);
+	}
+	decodersMutex.unlock();
+	std::stable_partition(found.begin(), found.end(), [capabilities](const std::shared_ptr<ImageDecoder>& decoder) {
+		return (decoder->getCapabilities() & capabilities) == capabilities;
+		});
+	return found;
+}
+
+ImageDataPtr DecoderRegistry::decode(const std::string& imagePath, int maxWidth, int maxHeight, int* fullWidth, int* fullHeight)
+{
+	// A decoder may still reject a file it recognized (a CMYK jpeg for example), the next one gets a try then
+	for (auto& decoder : findDecoders(imagePath, maxWidth > 0 ? DECODE_SCALED : 0)) {
+		ImageDataPtr image = decoder->decode(imagePath, maxWidth, maxHeight, fullWidth, fullHeight);
+		if (image)
+			return image;
+	}
+	return nullptr;
+}
+
+ImageDataPtr DecoderRegistry::decodeEmbedded(const std::string& imagePath, int* fullWidth, int* fullHeight)
+{
+	for (auto& decoder : findDecoders(imagePath, DECODE_EMBEDDED)) {
+		if (!(decoder->getCapabilities() & DECODE_EMBEDDED))
+			break;
+		ImageDataPtr image = decoder->decodeEmbedded(imagePath, fullWidth, fullHeight);
+		if (image)
+			return image;
+	}
+	return nullptr;
+}
+
+std::shared_ptr<TileSource> DecoderRegistry::openTiles(const std::string& imagePath)
+{
+	for (auto& decoder : findDecoders(imagePath, DECODE_REGION)) {
+		if (!(decoder->getCapabilities() & DECODE_REGION))
+			break;
+		std::shared_ptr<TileSource> tiles = decoder->openTiles(imagePath);
+		if (tiles)
+			return tiles;
+	}
+	return nullptr;
+}
+
+bool StbDecoder::sniff(const unsigned char* header, size_t length, unsigned long long fileSize)
+{
+	if (length >= 3 && header[0] == 0xFF && header[1] == 0xD8 && header[2] == 0xFF)
+		return true;
+	if (length >= 8 && memcmp(header, "\x89PNG\r\n\x1a\n", 8) == 0)
+		return true;
+	return length >= 2 && header[0] == 'B' && header[1] == 'M';
+}
+
+ImageDataPtr StbDecoder::decode(const std::string& imagePath, int maxWidth, int maxHeight, int* fullWidth, int* fullHeight)
+{
+	int width, height, channels;
+	unsigned char* data = stbi_load(imagePath.c_str(), &width, &height, &channels, 0);
+	if (data == nullptr)
+		return nullptr;
+	*fullWidth = width;
+	*fullHeight = height;
+	return std::make_shared<ImageData>(data, width, height, channels, stbi_image_free);
+}
+
+bool BinDecoder::sniff(const unsigned char* header, size_t length, unsigned long long fileSize)
+{
+	// No magic, but the header has to describe exactly this file
+	int width, height, channels;
+	if (length < 24)
+		return false;
+	return check_bin_header(header, fileSize, &width, &height, &channels) || check_bin_tiled_header(header, fileSize);
+}
+
+ImageDataPtr BinDecoder::decode(const std::string& imagePath, int maxWidth, int maxHeight, int* fullWidth, int* fullHeight)
+{
+	std::shared_ptr<BinTileSource> tiles = BinTileSource::open(imagePath);
+	if (tiles) {
+		// The smallest stored level that still covers the requested size
+		int level = 0;
+		while (maxWidth > 0 && maxHeight > 0 && level + 1 < tiles->getLevelCount()
+			&& (tiles->getLevelWidth(level + 1) >= maxWidth || tiles->getLevelHeight(level + 1) >= maxHeight))
+			level++;
+		*fullWidth = tiles->getWidth();
+		*fullHeight = tiles->getHeight();
+		return tiles->getLevel(level);
+	}
+	ImageDataPtr image = load_bin(imagePath);
+	if (!image)
+		return nullptr;
+	*fullWidth = image->width;
+	*fullHeight = image->height;
+	return image;
+}
+
+std::shared_ptr<TileSource> BinDecoder::openTiles(const std::string& imagePath)
+{
+	return BinTileSource::open(imagePath);
+}
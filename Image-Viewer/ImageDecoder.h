@@ -0,0 +1,80 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include "ImageData.h"
+#include "TileSource.h"
+
+#define DECODER_SNIFF_BYTES 64
+
+enum DecoderCapability {
+	DECODE_SCALED = 1,		// can decode at a reduced scale cheaper than at full
+	DECODE_REGION = 2,		// can decode a part of the image without the rest
+	DECODE_STREAMING = 4,	// decodes row by row without holding the whole file
+	DECODE_EMBEDDED = 8		// can read a preview stored in the file
+};
+
+// A backend for one or more image formats. Decoders are picked by the magic bytes of the file,
+// the extension is only used to list the images of a folder.
+class ImageDecoder
+{
+public:
+	virtual ~ImageDecoder() = default;
+	virtual const char* getName() = 0;
+	virtual std::vector<std::string> getExtensions() = 0;
+	virtual int getCapabilities() = 0;
+	virtual int getBitDepth() { return 8; }	// bits per channel of the decoded pixels
+	// header holds the first DECODER_SNIFF_BYTES of the file (less for smaller files)
+	virtual bool sniff(const unsigned char* header, size_t length, unsigned long long fileSize) = 0;
+	// maxWidth and maxHeight are only a hint for DECODE_SCALED decoders, 0 decodes the full resolution
+	virtual ImageDataPtr decode(const std::string& imagePath, int maxWidth, int maxHeight, int* fullWidth, int* fullHeight) = 0;
+	virtual ImageDataPtr decodeEmbedded(const std::string& imagePath, int* fullWidth, int* fullHeight) { return nullptr; }
+	// Random access to the tiles of a file that stores them, only for DECODE_REGION decoders
+	virtual std::shared_ptr<TileSource> openTiles(const std::string& imagePath) { return nullptr; }
+};
+
+// Every decoder that recognizes a file is tried, the most recently registered first, so a specialised decoder
+// registered later overrides a general one. Among those the first with the wanted capabilities goes first.
+// Built in are, by priority, libjpeg (when available), stb_image and the .bin format.
+class DecoderRegistry
+{
+public:
+	static DecoderRegistry* getInstance();
+
+	// Registered decoders are preferred over the ones registered before them
+	void registerDecoder(std::shared_ptr<ImageDecoder> decoder);
+	bool supportsExtension(std::string extension);
+	std::vector<std::shared_ptr<ImageDecoder>> findDecoders(const std::string& imagePath, int capabilities = 0);
+
+	ImageDataPtr decode(const std::string& imagePath, int maxWidth, int maxHeight, int* fullWidth, int* fullHeight);
+	ImageDataPtr decodeEmbedded(const std::string& imagePath, int* fullWidth, int* fullHeight);
+	std::shared_ptr<TileSource> openTiles(const std::string& imagePath);
+private:
+	DecoderRegistry();
+
+	std::mutex decodersMutex;
+	std::vector<std::shared_ptr<ImageDecoder>> decoders;
+};
+
+class StbDecoder : public ImageDecoder
+{
+public:
+	const char* getName() override { return "stb_image"; }
+	std::vector<std::string> getExtensions() override { return { ".jpg", ".jpeg", ".png", ".bmp" }; }
+	int getCapabilities() override { return 0; }
+	bool sniff(const unsigned char* header, size_t length, unsigned long long fileSize) override;
+	ImageDataPtr decode(const std::string& imagePath, int maxWidth, int maxHeight, int* fullWidth, int* fullHeight) override;
+};
+
+class BinDecoder : public ImageDecoder
+{
+public:
+	const char* getName() override { return "bin"; }
+	std::vector<std::string> getExtensions() override { return { ".bin" }; }
+	// Only tiled files have levels to scale from and tiles to read on their own
+	int getCapabilities() override { return DECODE_SCALED | DECODE_REGION; }
+	bool sniff(const unsigned char* header, size_t length, unsigned long long fileSize) override;
+	ImageDataPtr decode(const std::string& imagePath, int maxWidth, int maxHeight, int* fullWidth, int* fullHeight) override;
+	std::shared_ptr<TileSource> openTiles(const std::string& imagePath) override;
+};
@@ -1,24 +1,51 @@
 #include "ImageManagment.h"
+#include "SaveService.h"
+#include "HsvKernels.h"
+#include "Orientation.h"
 #include <GLFW/glfw3.h>
 #include "App.h"
 std::mutex ImageManagment::instanceMutex;
 std::mutex ImageManagment::imagesMutex;
-std::mutex ImageManagment::reloadImagesMutex;
-std::mutex ImageManagment::shouldOpenImageMutex;
+std::mutex ImageManagment::loaderQueueMutex;
+std::condition_variable ImageManagment::loaderQueueCondition;
 
 ImageManagment* ImageManagment::instance = nullptr;
-std::vector<std::string> ImageManagment::imageExtensions = {
-	".jpg", ".jpeg", ".png", ".bmp", ".bin"
-};
 ImageManagment::ImageManagment() {
 	images.reserve(10);
 	selectedIndex = -1;
+	decodePool = new DecodePool([this](DecodeJob job, ImageDataPtr imageData) {
+		// The reduced scale pass is shown first, the full resolution is decoded after it
+		if (!job.tileSource && job.maxWidth > 0 && imageData && imageData->width < job.fullWidth) {
+			enqueueCommand({ UPLOAD_IMAGE, job.imagePath, job.index, job.folderGeneration, imageData, nullptr, true, job.fullWidth, job.fullHeight });
+			job.maxWidth = job.maxHeight = 0;
+			decodePool->followUp(job);
+			return;
+		}
+		std::shared_ptr<TiledImage> tiles;
+		// The file has its own pyramid, only its coarsest level was read
+		if (imageData && job.tileSource)
+			tiles = std::make_shared<TiledImage>(job.tileSource);
+		else if (imageData && TiledImage::needsTiling(imageData->width, imageData->height)) {
+			tiles = std::make_shared<TiledImage>(std::make_shared<PyramidTileSource>(imageData));
+			imageData = tiles->getPreview();
+		}
+		enqueueCommand({ UPLOAD_IMAGE, job.imagePath, job.index, job.folderGeneration, imageData, tiles });
+		});
+	uploadQueue = new UploadQueue();
+	imageCache = new ImageCache();
+	thumbnails = new ThumbnailCache();
+	saves = new SaveService(imageCache);
 }
 
 ImageManagment::~ImageManagment()
 {
 	shouldRunManagment = false;
+	delete saves;
+	delete decodePool;
 	clearImages();
+	delete uploadQueue;
+	delete imageCache;
+	delete thumbnails;
 }
 
 int ImageManagment::loadImages(std::string imagePath)
@@ -26,25 +53,18 @@ int ImageManagment::loadImages(std::string imagePath)
 	if (imagePath.empty())
 		return 0;
 	clearImages();
-	shouldOpenImageMutex.lock();
-	shouldOpenImage = false;
-	shouldOpenImageMutex.unlock();
+	imageCache->clear();
 
 	if (!fs::exists(imagePath) || !fs::is_regular_file(imagePath)) {
 		return -1;
 	}
 	imagesMutex.lock();
+	folderGeneration++;
+	lastLoadedSelection = -1;
 	currentPath = fs::path(imagePath);
 	fs::path parrentPath = currentPath.parent_path();
 	for (fs::path p : fs::directory_iterator(parrentPath)) {
-		std::string extention = p.extension().string();
-
-		std::transform(extention.begin(), extention.end(), extention.begin(), ::tolower);
-
-		if (!std::any_of(
-			imageExtensions.begin(),
-			imageExtensions.end(),
-			[&extention](const std::string& ext) { return ext == extention; }))
+		if (!DecoderRegistry::getInstance()->supportsExtension(p.extension().string()))
 			continue;
 
 		Image i = { -1, 0, 0, p.string()}; // TODO: Maybe don't copy the path so much
@@ -64,62 +84,138 @@ int ImageManagment::loadImages(std::string imagePath)
 	return 1;
 }
 
-void ImageManagment::loadImage(Image* image) {
-	if (image->texId != -1)
+void ImageManagment::loadImage(int index, int priority, DecodeJob* previewJob) {
+	Image* image = &images[index];
+	imageCache->touch(image->imagePath, index);
+	if (image->texId != -1 && !image->isPreview) {
+		// The neighbours stay resident while browsing, only the image navigated to reuses its texture
+		if (priority == 0 && index != lastLoadedSelection)
+			imageCache->countTextureHit();
 		return;
-	
-	int width, height, num_channels;
-	unsigned char* image_data = nullptr;
-	bool isBin = image->imagePath.ends_with(".bin");
-	if (!isBin) {
-		image_data = stbi_load(image->imagePath.c_str(), &width, &height, &num_channels, 0);
-	}
-	else {
-		image_data = load_bin(image->imagePath.c_str(), &width, &height, &num_channels);
 	}
+	if (image->isDecoding)
+		return;
+	image->isDecoding = true;
 
-	if (!image_data) {
+	ImageDataPtr imageData;
+	std::shared_ptr<TiledImage> tiles;
+	if (imageCache->getPixels(image->imagePath, imageData, tiles)) {
+		imageCache->countPixelHit();
+		queueUpload(index, imageData, tiles);
 		return;
 	}
-	App::windowMutex.lock();
-	glfwMakeContextCurrent(App::window);
-	GLuint texture;
-	glGenTextures(1, (&texture));
-	glBindTexture(GL_TEXTURE_2D, texture);
+	imageCache->countMiss();
+	DecodeJob job = { index, image->imagePath, priority, folderGeneration };
+	if (priority == 0 && image->texId == -1 && viewWidth > 0 && viewHeight > 0 && previewJob) {
+		// Submitted by the caller after the embedded thumbnail, which is decoded without imagesMutex
+		job.maxWidth = viewWidth;
+		job.maxHeight = viewHeight;
+		*previewJob = job;
+		return;
+	}
+	decodePool->submit(job);
+}
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+void ImageManagment::processUploads()
+{
+	uploadQueue->process(UPLOAD_TIME_BUDGET, selectedIndex,
+		[this](const UploadJob& job) {
+			return job.folderGeneration == folderGeneration && abs(job.index - selectedIndex) <= PREFETCH_DISTANCE;
+		},
+		[this](const UploadJob& job, unsigned int texId) {
+			std::lock_guard g(imagesMutex);
+			if (job.folderGeneration != folderGeneration || job.index >= images.size()) {
+				if (texId != -1)
+					glDeleteTextures(1, &texId);
+				return;
+			}
+			Image* image = &images[job.index];
+			if (!job.preview)
+				image->isDecoding = false;
+			if (texId == -1)
+				return;
+			// Later passes replace a preview, the embedded thumbnail is followed by the scaled decode and then the full resolution
+			if (image->texId != -1 && !image->isPreview) {
+				glDeleteTextures(1, &texId);
+				return;
+			}
+			if (image->texId != -1) {
+				uploadQueue->deleteTexture(image->texId);
+				imageCache->removeTexture(image->imagePath);
+			}
+			else {
+				// The preview already set the size, it may have been rotated since
+				image->w = job.preview ? job.fullWidth : job.tiles ? job.tiles->getWidth() : job.imageData->width;
+				image->h = job.preview ? job.fullHeight : job.tiles ? job.tiles->getHeight() : job.imageData->height;
+				image->saveWidth = image->w;
+				image->saveHeight = image->h;
+			}
+			image->texId = texId;
+			image->isPreview = job.preview;
+			image->tiles = job.tiles;
+			image->channels = job.imageData->channels;
+			if (image->tiles)
+				image->tiles->restore();
+			imageCache->addTexture(image->imagePath, job.index, (size_t)job.imageData->width * job.imageData->height * 4 * 4 / 3);
+			evictTextures();
+		});
+}
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, num_channels == 3 ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, (void*)image_data);
-	glfwMakeContextCurrent(nullptr);
-	App::windowMutex.unlock();
-	if (!isBin) {
-		stbi_image_free(image_data);
+void ImageManagment::finishImage(LoaderCommand& command)
+{
+	std::lock_guard g(imagesMutex);
+	if (command.generation != folderGeneration || command.index < 0 || command.index >= images.size())
+		return;
+	Image* image = &images[command.index];
+	if (!command.imageData) {
+		image->isDecoding = false;
+		return;
 	}
-	else {
-		delete[] image_data;
+	// Not cached, the full resolution follows
+	if (command.preview) {
+		if (image->texId == -1 && abs(command.index - selectedIndex) <= PREFETCH_DISTANCE)
+			queueUpload(command.index, command.imageData, nullptr, true, command.fullWidth, command.fullHeight);
+		return;
+	}
+	// A tiled image keeps its whole pyramid, a third more than the full resolution
+	size_t bytes = command.tiles ? command.tiles->getSource()->getResidentBytes() + command.imageData->size() : command.imageData->size();
+	imageCache->putPixels(image->imagePath, command.index, command.imageData, command.tiles, bytes, selectedIndex);
+	if (abs(command.index - selectedIndex) > PREFETCH_DISTANCE) {
+		image->isDecoding = false;
+		return;
 	}
+	queueUpload(command.index, command.imageData, command.tiles);
+}
 
-	image->texId = texture;
-	image->w = width;
-	image->h = height;
-	image->saveWidth = width;
-	image->saveHeight = height;
-	image->channels = num_channels;
+void ImageManagment::queueUpload(int index, ImageDataPtr imageData, std::shared_ptr<TiledImage> tiles, bool preview, int fullWidth, int fullHeight)
+{
+	UploadJob evicted;
+	if (!uploadQueue->push({ index, folderGeneration, imageData, tiles, preview, fullWidth, fullHeight }, selectedIndex, evicted)) {
+		// A dropped preview still has its full decode in flight, that one clears the flag when it is done
+		if (!evicted.preview && evicted.folderGeneration == folderGeneration && evicted.index < images.size())
+			images[evicted.index].isDecoding = false;
+	}
+}
 
+void ImageManagment::evictTextures()
+{
+	for (int index : imageCache->textureVictims(selectedIndex)) {
+		unloadImage(&images[index]);
+	}
 }
 
 void ImageManagment::unloadImage(Image* image)
 {
 	if (image->texId == -1)
 		return;
-	App::windowMutex.lock();
-	glfwMakeContextCurrent(App::window);
-	glDeleteTextures(1, &image->texId);
+	uploadQueue->deleteTexture(image->texId);
 	image->texId = -1;
+	image->isPreview = false;
+	imageCache->removeTexture(image->imagePath);
+	if (image->tiles) {
+		image->tiles->release([this](unsigned int texId) { uploadQueue->deleteTexture(texId); });
+		image->tiles.reset();
+	}
 	image->w = image->h = 0;
 	if (image->flipX)
 		flipImageX(image);
@@ -130,8 +226,12 @@ void ImageManagment::unloadImage(Image* image)
 	image->uv[2] = { 1, 1 };
 	image->uv[3] = { 0, 1 };
 	image->rotation = 0;
-	glfwMakeContextCurrent(nullptr);
-	App::windowMutex.unlock();
+}
+
+std::shared_ptr<TiledImage> ImageManagment::getTiles(Image* image)
+{
+	std::lock_guard g(imagesMutex);
+	return image->tiles;
 }
 
 void ImageManagment::clearImages() {
@@ -144,14 +244,14 @@ void ImageManagment::clearImages() {
 }
 void ImageManagment::deleteInstance()
 {
-	instance->shouldRunManagment = false;
+	instance->stopManagment();
 	instanceMutex.lock();
 	if (instance)
 		delete instance;
 	instanceMutex.unlock();
 }
 Image* ImageManagment::getImageAt(int i) {
-	if (i < 0 && i >= images.size())
+	if (i < 0 || i >= images.size())
 		return nullptr;
 	return &images[i];
 }
@@ -164,6 +264,19 @@ void ImageManagment::decreaseZoom()
 	if(zoom > 0.25f)
 		zoom -= 0.1f;
 }
+ViewTransform ImageManagment::getViewTransform()
+{
+	ViewTransform view;
+	view.zoom = zoom;
+	view.angle = angle;
+	view.translationX = translationX;
+	view.translationY = translationY;
+	if (getCurrentImage() != nullptr) {
+		view.width = getCurrentImage()->saveWidth;
+		view.height = getCurrentImage()->saveHeight;
+	}
+	return view;
+}
 void ImageManagment::rotateCurrentImage(int dir)
 {
 
@@ -230,288 +343,170 @@ Image* ImageManagment::getCurrentImage() {
 void ImageManagment::runManagment(std::string imagePath)
 {
 	setImagesPath(imagePath);
-	bool sri = false;
-	bool sli = false;
-	while (shouldRunManagment) {
-		shouldOpenImageMutex.lock();
-		sli = shouldOpenImage;
-		shouldOpenImageMutex.unlock();
-
-		if (sli)
-			loadImages(currentPath.string());
-
-		reloadImagesMutex.lock();
-		sri = shouldReloadImages;
-		reloadImagesMutex.unlock();
-		if (sri) {
+	while (true) {
+		std::unique_lock lock(loaderQueueMutex);
+		loaderQueueCondition.wait(lock, [this] { return !loaderQueue.empty(); });
+		LoaderCommand command = loaderQueue.front();
+		loaderQueue.pop_front();
+		processedCommands++;
+		lock.unlock();
+
+		switch (command.type)
+		{
+		case OPEN_IMAGES:
+			loadImages(command.imagePath);
+			break;
+		case RELOAD_IMAGES:
 			loadCloseImages();
+			break;
+		case UPLOAD_IMAGE:
+			finishImage(command);
+			break;
+		case STOP_MANAGMENT:
+			return;
+		default:
+			break;
 		}
-
-		std::this_thread::sleep_for(std::chrono::milliseconds(50));
 	}
 }
 
 void ImageManagment::stopManagment()
 {
-	this->shouldRunManagment = false;
+	enqueueCommand({ STOP_MANAGMENT });
+}
+
+void ImageManagment::enqueueCommand(LoaderCommand command)
+{
+	loaderQueueMutex.lock();
+	// Nothing runs after a stop, whatever the decode workers still send
+	if (!shouldRunManagment) {
+		loaderQueueMutex.unlock();
+		return;
+	}
+	if (command.type == STOP_MANAGMENT)
+		shouldRunManagment = false;
+	size_t before = loaderQueue.size();
+	// Opening a folder reloads the close images itself, so it supersedes everything that is still pending.
+	// A reload reads selectedIndex when it runs, so one pending reload (or open) already covers the new one.
+	if (command.type == OPEN_IMAGES || command.type == STOP_MANAGMENT) {
+		loaderQueue.clear();
+		loaderQueue.push_back(command);
+	}
+	else if (command.type != RELOAD_IMAGES || !std::any_of(loaderQueue.begin(), loaderQueue.end(),
+		[](const LoaderCommand& c) { return c.type == OPEN_IMAGES || c.type == RELOAD_IMAGES; })) {
+		loaderQueue.push_back(command);
+	}
+	coalescedCommands += before + 1 - loaderQueue.size();
+	loaderQueueMutex.unlock();
+	loaderQueueCondition.notify_one();
+}
+
+int ImageManagment::getLoaderQueueDepth()
+{
+	std::lock_guard g(loaderQueueMutex);
+	return loaderQueue.size();
 }
 
 void ImageManagment::loadCloseImages()
 {
-	int j = 0;
-	int counter;
-	while (true) {
-		if (j <= NUMBER_OF_LOADED_IMAGES) {
+	DecodeJob previewJob;
+	{
+		std::lock_guard g(imagesMutex);
+		if (selectedIndex < 0 || selectedIndex >= images.size())
+			return;
+		decodePool->retarget(selectedIndex, PREFETCH_DISTANCE, folderGeneration);
+		for (int j = 0; j <= PREFETCH_DISTANCE; j++) {
 			if (selectedIndex + j < images.size())
-				loadImage(&images[selectedIndex + j]);
-			if (selectedIndex - j >= 0)
-				loadImage(&images[selectedIndex - j]);
+				loadImage(selectedIndex + j, j, &previewJob);
+			if (j > 0 && selectedIndex - j >= 0)
+				loadImage(selectedIndex - j, j);
 		}
-		else {
-			counter = 0;
-			if (selectedIndex - j >= 0) {
-				unloadImage(&images[selectedIndex - j]);
-				counter++;
-			}
-			if (selectedIndex + j < (int)images.size()) {
-				unloadImage(&images[selectedIndex + j]);
-				counter++;
-			}
-			if (counter == 0) {
-				break;
-			}
+		lastLoadedSelection = selectedIndex;
+		evictTextures();
+	}
+	if (previewJob.index < 0)
+		return;
+	// The embedded thumbnail is only a few kB, it is shown while the decode pool works on the scaled pass.
+	// The render thread keeps its access to images while it decodes, only the result is published under the lock.
+	int fullWidth, fullHeight;
+	ImageDataPtr thumbnail = DecoderRegistry::getInstance()->decodeEmbedded(previewJob.imagePath, &fullWidth, &fullHeight);
+	if (thumbnail) {
+		std::lock_guard g(imagesMutex);
+		if (previewJob.folderGeneration == folderGeneration && previewJob.index < images.size() && images[previewJob.index].texId == -1) {
+			queueUpload(previewJob.index, thumbnail, nullptr, true, fullWidth, fullHeight);
+			embeddedPreviews++;
 		}
-		j++;
 	}
+	decodePool->submit(previewJob);
 }
 
 void ImageManagment::setImagesPath(std::string imagePath)
 {
-	shouldOpenImageMutex.lock();
 	currentPath = imagePath;
-	shouldOpenImage = true;
 	selectedIndex = -1;
-	shouldOpenImageMutex.unlock();
+	enqueueCommand({ OPEN_IMAGES, imagePath });
 }
 
-void saveImage(Image image, std::string newFilePath, int type, bool transform, int quality)
+bool saveImage(const Image& image, std::string newFilePath, int type, int quality, const ViewTransform* view, ImageCache* cache)
 {
-	if (newFilePath.empty())
-		newFilePath = image.imagePath;
-	int width, height, num_channels;
-	unsigned char* data = stbi_load(image.imagePath.c_str(), &width, &height, &num_channels, 0);
-	if (image.flipX) {
-		flipDataX(width, height, data, num_channels);
-	}
-	if (image.flipY) {
-		flipDataY(width, height, data, num_channels);
-	}
-	int p = 0;
-	image.rotation = (image.rotation + 4) % 4;
-	switch (image.rotation)
-	{
-	case 1:
-		rotateData90(width, height, data, num_channels);
-		p = width;
-		width = height;
-		height = p;
-		break;
-	case 2:
-		flipDataX(width, height, data, num_channels);
-		flipDataY(width, height, data, num_channels);
-		break;
-	case 3:
-		rotateData90(width, height, data, num_channels);
-		p = width;
-		width = height;
-		height = p;
-		flipDataY(width, height, data, num_channels);
-		break;
-	default:
-		break;
-	}
-	if (image.mod.saturation != 1.0 || image.mod.brightness != 1.0 || image.mod.hue != 0.0) {
-		hsvEdit(width, height, data, image.mod.hue, image.mod.saturation, image.mod.brightness, num_channels);
-	}
-	unsigned char* tdata = nullptr;
-	if (transform)
-		tdata = transformImage(&image, data, &width, &height, num_channels);
-	else
-		tdata = data;
-
-	switch (type)
-	{
-	case PNG:
-		stbi_write_png(newFilePath.c_str(), width, height, num_channels, tdata, width* num_channels);
-		break;
-	case JPG:
-		stbi_write_jpg(newFilePath.c_str(), width, height, num_channels, tdata, quality);
-		break;
-	case BMP:
-		stbi_write_bmp(newFilePath.c_str(), width, height, num_channels, tdata);
-		break;
-	case BIN:
-		write_bin(newFilePath.c_str(), width, height, num_channels, tdata);
-		break;
-	default:
-		break;
-	}
-	if (transform)
-		delete[] tdata;
-	stbi_image_free(data);
-}
-
-unsigned char* transformImage(Image* image, unsigned char* data, int* width, int* height, int channels)
-{
-	int originalWidth = image->w;
-	int originalHeight = image->h;
-	int nw = *width = image->saveWidth;
-	int nh = *height = image->saveHeight;
-
-	float angle = ImageManagment::getInstance()->getAngle();
-
-	float cosA = cos(-angle);
-	float sinA = sin(-angle);
-
-	float translationX = -ImageManagment::getInstance()->getTranslationX() * originalWidth;
-	float translationY = -ImageManagment::getInstance()->getTranslationY() * originalHeight;
-
-	float zoom = 1.0/ImageManagment::getInstance()->getZoom();
-
-	int zoomedWidth = zoom * originalWidth;
-	int zoomedHeight = zoom * originalHeight;
-
-	unsigned char* tdata = new unsigned char[nw * nh * channels];
-
-	std::fill(tdata, &tdata[nw * nh * channels], 0);
-
-	int centeredX, centeredY;
-	int tempX, tempY;
-
-	int finalX, finalY;
-	for (int y = 0; y < nh; y++) {
-		centeredY = y + (zoomedHeight - nh) / 2;
-		for (int x = 0; x < nw; x++) {
-			centeredX = x + (zoomedWidth - nw) / 2;
-
-			//centeredX and centeredY representet the image shifted so that the cutout of the image is in the middle of the screen
-
-			tempX = centeredX + translationX;
-			tempY = centeredY + translationY;
-
-			//Adding the translation
-
-			tempX -= zoomedWidth / 2;
-			tempY -= zoomedHeight / 2;
-
-			// Move it so that the middle of the image is the center of rotation
-
-			finalX = tempX * cosA - tempY * sinA;
-			finalY = tempX * sinA + tempY * cosA;
-
-			// The rotation
-
-			finalX *= zoom;
-			finalY *= zoom;
-
-			//Applying the zoom
-
-			finalX += originalWidth / 2;
-			finalY += originalHeight / 2;
-
-			//Going back so that the begining of the image would be (0, 0)
-
-			if (finalX >= 0 && finalX < originalWidth && finalY >= 0 && finalY < originalHeight)
-				for (int c = 0; c < channels; c++) {
-						tdata[y * nw * channels + x * channels + c] = data[finalY * originalWidth * channels + finalX * channels + c];
-				}
-		}
-	}
-	return tdata;
+	SaveJob job;
+	job.image = image;
+	job.path = newFilePath.empty() ? image.imagePath : newFilePath;
+	job.type = type;
+	job.transform = view != nullptr;
+	job.quality = quality;
+	if (view)
+		job.view = *view;
+	return runSave(job, cache);
 }
 
-void write_bin(const char* path, int width, int height, int channels, unsigned char* data)
-{
-	//	resolution x(4 bajta)	- rezolucija slike x(recimo 1920)
-	//	resolution y(4 bajta)	- rezolucija slike y(recimo 1080)
-	//	type(4 bajta)			- tip(0 inicijalno)
-	//	rgb(4 bajta)			- 0 za 24 bita, 1 za 32 bita rgb
-	//	xor (4 bajta)			- tip kodiranja - sifriranja piksela(ako je 0 nema kodiranja)
-	//	len(4 bajta)			- ukupna duzina fajla(ukljucujuci i ovaj header duzine 24 bajta)
-	std::ofstream writer(path, std::ios::out | std::ios::binary);
-	if (!writer.is_open()) {
-		return; // TODO
-	}
-	unsigned int p = 0;
-	writer.write(reinterpret_cast<char*>(&width), sizeof(width));
-	writer.write(reinterpret_cast<char*>(&height), sizeof(height));
-	writer.write(reinterpret_cast<char*>(&p), sizeof(p));
-	writer.write(reinterpret_cast<char*>(&channels), sizeof(channels));
-	writer.write(reinterpret_cast<char*>(&p), sizeof(p));
-	p = 24 + width * height * channels;
-	writer.write(reinterpret_cast<char*>(&p), sizeof(p));
-	writer.write((char*)data, width*height*channels);
-	writer.close();
-}
-
-unsigned char* load_bin(const char* path, int* width, int* height, int* channels)
-{
-	std::ifstream reader(path, std::ios::binary | std::ios::in);
-	if (!reader.is_open()) {
-		return nullptr; //TODO
-	}
-	int p = 0;
-	reader.read(reinterpret_cast<char*>(width), 4);
-	reader.read(reinterpret_cast<char*>(height), 4);
-	reader.read(reinterpret_cast<char*>(&p), 4);
-	reader.read(reinterpret_cast<char*>(channels), 4);
-	reader.read(reinterpret_cast<char*>(&p), 4);
-	int len = 0;
-	reader.read(reinterpret_cast<char*>(&len), 4);
-	unsigned char* data = new unsigned char[len - 24];
-	reader.read((char*)data, len - 24);
-	reader.close();
-	return data;
-}
-
-void flipDataX(int width, int height, unsigned char* data, int channels)
+ImageDataPtr decodeImage(const std::string& imagePath, int maxWidth, int maxHeight, int* fullWidth, int* fullHeight, std::shared_ptr<TileSource>* tileSource)
 {
-	for (int y = 0; y < height; y++) {
-		for (int i = 0; i < width / 2; i++) {
-			for(int c = 0; c < channels; c++)
-				std::swap(data[y * width * channels + i * channels + c], data[y * width * channels + (width - i - 1) * channels + c]);
+	int unusedWidth, unusedHeight;
+	if (!fullWidth || !fullHeight) {
+		fullWidth = &unusedWidth;
+		fullHeight = &unusedHeight;
+	}
+	if (tileSource) {
+		std::shared_ptr<TileSource> tiles = DecoderRegistry::getInstance()->openTiles(imagePath);
+		if (tiles && TiledImage::needsTiling(tiles->getWidth(), tiles->getHeight())) {
+			*fullWidth = tiles->getWidth();
+			*fullHeight = tiles->getHeight();
+			*tileSource = tiles;
+			return tiles->getTile(tiles->getLevelCount() - 1, 0, 0);
 		}
 	}
+	return DecoderRegistry::getInstance()->decode(imagePath, maxWidth, maxHeight, fullWidth, fullHeight);
 }
 
-void flipDataY(int width, int height, unsigned char* data, int channels)
+bool check_bin_header(const unsigned char* header, unsigned long long fileSize, int* width, int* height, int* channels)
 {
-	for (int y = 0; y < height / 2; y++) {
-		for (int x = 0; x < width; x++) {
-			for(int i = 0; i < channels; i++)
-				std::swap(data[(y * width + x) * channels + i], data[((height - y - 1) * width + x) * channels + i]);
-		}
-	}
+	if (fileSize < 24)
+		return false;
+	unsigned int fields[6];
+	memcpy(fields, header, 24);
+	unsigned int w = fields[0], h = fields[1], type = fields[2], c = fields[3], xorType = fields[4], len = fields[5];
+	if (type != 0 || xorType != 0 || c < 1 || c > 4 || w == 0 || h == 0)
+		return false;
+	// len is only 32 bits, it wraps around for files over 4 GB
+	if (len != (unsigned int)fileSize || 24 + (unsigned long long)w * h * c != fileSize)
+		return false;
+	*width = w;
+	*height = h;
+	*channels = c;
+	return true;
 }
 
-void rotateData90(int width, int height, unsigned char* data, int channels)
+ImageDataPtr load_bin(const std::string& path)
 {
-	char* tmp = new char[width * height * channels];
-	for (int y = 0; y < height; ++y) {
-		for (int x = 0; x < width; ++x) {
-			for (int i = 0; i < channels; i++) {
-				tmp[(x * height + (height - y - 1)) * channels + i] = data[y * width * channels + x * channels + i];
-			}
-		}
-	}
-	for (int y = 0; y < height; ++y) {
-		for (int x = 0; x < width; ++x) {
-			for (int i = 0; i < channels; i++) {
-				data[(y * width + x) * channels + i] = tmp[(y * width + x) * channels + i];
-			}
-		}
-	}
-	delete[] tmp;
+	std::shared_ptr<MappedFile> file = MappedFile::open(path);
+	if (!file)
+		return nullptr;
+	int width, height, channels;
+	if (!check_bin_header(file->getData(), file->getSize(), &width, &height, &channels))
+		return nullptr;
+	// The pixels are used straight from the mapping, it is unmapped with the last reference to them
+	return std::make_shared<ImageData>(file->getData() + 24, width, height, channels, [file](unsigned char* data) {});
 }
 
 void contrast(int width, int height, unsigned char* data, float contrast, int channels)
@@ -529,31 +524,7 @@ void contrast(int width, int height, unsigned char* data, float contrast, int ch
 
 void hsvEdit(int width, int height, unsigned char* data, float hue, float saturation, float value, int channels)
 {
-	for (int y = 0; y < height; ++y) {
-		for (int x = 0; x < width; ++x) {
-			unsigned char* pixel = data + y * width * channels + x * channels;
-
-			float r = ((float)pixel[0]) / 255.0f;
-			float g = ((float)pixel[1]) / 255.0f;
-			float b = ((float)pixel[2]) / 255.0f;
-			float h = 0, s = 0, v = 0;
-
-			RGBtoHSV(r, g, b, h, s, v);
-
-			h += hue;
-			h = h > 360.0 ? h - 360.0 : h;
-			s *= saturation;
-			s = s > 1.0 ? 1.0 : s;
-			v *= value;
-			v = v > 1.0 ? 1.0 : v;
-
-			HSVtoRGB(r, g, b, h, s, v);
-			
-			pixel[0] = (unsigned char)(r * 255.0f);
-			pixel[1] = (unsigned char)(g * 255.0f);
-			pixel[2] = (unsigned char)(b * 255.0f);
-		}
-	}
+	hsvEditWith(hsvBestKernel(), width, height, data, hue, saturation, value, channels);
 }
 
 // Thanks for the conversion :  https://gist.github.com/fairlight1337/4935ae72bcbcc1ba5c72
@@ -1,5 +1,7 @@
 #pragma once
 #include <mutex>
+#include <condition_variable>
+#include <deque>
 #include <vector>
 #include <filesystem>
 #include "stb_image.h"
@@ -8,10 +10,23 @@
 #include <imgui.h>
 #include <functional>
 #include "ImageShaderModification.h"
+#include "ImageData.h"
+#include "DecodePool.h"
+#include "UploadQueue.h"
+#include "TiledImage.h"
+#include "ImageCache.h"
+#include "ThumbnailCache.h"
+#include "ImageDecoder.h"
+#include "MappedFile.h"
+#include "BinFormat.h"
+#include "SavePipeline.h"
+#include "RowWriter.h"
 #include <iostream>
 #include<fstream>
 namespace fs = std::filesystem;
-#define NUMBER_OF_LOADED_IMAGES 2
+class SaveService;
+#define PREFETCH_DISTANCE 2
+#define UPLOAD_TIME_BUDGET 0.008
 struct Image {
 	unsigned int texId = -1;
 	unsigned int w = 0, h = 0;
@@ -22,6 +37,23 @@ struct Image {
 	ImageShaderModification mod;
 	int saveWidth = 0, saveHeight = 0;
 	unsigned int channels = 0;
+	bool isDecoding = false;
+	bool isPreview = false;				// texId is a reduced scale decode, the full resolution is still decoding
+	std::shared_ptr<TiledImage> tiles;	// only for images too large for a single texture, texId is then its preview
+};
+
+enum LoaderCommandType {
+	OPEN_IMAGES = 0, RELOAD_IMAGES, UPLOAD_IMAGE, STOP_MANAGMENT
+};
+struct LoaderCommand {
+	LoaderCommandType type;
+	std::string imagePath;
+	int index = -1;
+	unsigned int generation = 0;	// folder generation, results from a previously opened folder are ignored
+	ImageDataPtr imageData;
+	std::shared_ptr<TiledImage> tiles;
+	bool preview = false;				// reduced scale pass of an image that is fullWidth x fullHeight
+	int fullWidth = 0, fullHeight = 0;
 };
 
 class ImageManagment
@@ -33,22 +65,36 @@ private:
 	static ImageManagment* instance;
 	static std::mutex instanceMutex;
 	static std::mutex imagesMutex;
-	static std::mutex reloadImagesMutex;
-	static std::mutex shouldOpenImageMutex;
+	static std::mutex loaderQueueMutex;
+	static std::condition_variable loaderQueueCondition;
 
-	static std::vector<std::string> imageExtensions;
 	std::vector<Image> images;
+	unsigned int folderGeneration = 0;
 	int selectedIndex;
+	int lastLoadedSelection = -1;	// selected index of the last loadCloseImages, a texture hit is counted once per newly selected image
 	fs::path currentPath;
 	float zoom = 1.0f;
 	float translationX = 0, translationY = 0;
 	float angle = 0.0f;
+	int viewWidth = 0, viewHeight = 0;
 
-	bool shouldReloadImages = false;
+	std::deque<LoaderCommand> loaderQueue;
+	unsigned int coalescedCommands = 0;
+	unsigned int processedCommands = 0;
+	unsigned int embeddedPreviews = 0;
 
 	bool shouldRunManagment = true;
 
-	bool shouldOpenImage = true;
+	DecodePool* decodePool = nullptr;
+	UploadQueue* uploadQueue = nullptr;
+	ImageCache* imageCache = nullptr;
+	ThumbnailCache* thumbnails = nullptr;
+	SaveService* saves = nullptr;
+
+	void enqueueCommand(LoaderCommand command);
+	void finishImage(LoaderCommand& command);
+	void queueUpload(int index, ImageDataPtr imageData, std::shared_ptr<TiledImage> tiles, bool preview = false, int fullWidth = 0, int fullHeight = 0);
+	void evictTextures();
 public:
 	static ImageManagment* getInstance() {
 		instanceMutex.lock();
@@ -62,8 +108,13 @@ public:
 
 	void clearImages();
 	int loadImages(std::string imagePath);
-	void loadImage(Image* image);
+	// With previewJob the selected image's scaled decode is returned there instead of submitted, for loadCloseImages to
+	// submit once it has shown the embedded thumbnail
+	void loadImage(int index, int priority, DecodeJob* previewJob = nullptr);
+	// Only on the render thread, uploads decoded images within UPLOAD_TIME_BUDGET
+	void processUploads();
 	void unloadImage(Image* image);
+	std::shared_ptr<TiledImage> getTiles(Image* image);
 	Image* getCurrentImage();
 	Image* getImageAt(int i);
 	int getNumberOfImages() { return images.size(); }
@@ -71,16 +122,12 @@ public:
 	void next() {
 		resetAll();
 		selectedIndex = selectedIndex < (images.size() - 1) ? selectedIndex + 1 : selectedIndex;
-		reloadImagesMutex.lock();
-		shouldReloadImages = true;
-		reloadImagesMutex.unlock();
+		enqueueCommand({ RELOAD_IMAGES });
 	}
 	void prev() {
 		resetAll();
 		selectedIndex = selectedIndex > 0 ? selectedIndex - 1 : selectedIndex;
-		reloadImagesMutex.lock();
-		shouldReloadImages = true;
-		reloadImagesMutex.unlock();
+		enqueueCommand({ RELOAD_IMAGES });
 	}
 
 	void changeSelectedIndex(int i) {
@@ -88,10 +135,10 @@ public:
 			return;
 		resetAll();
 		selectedIndex += i;
-		reloadImagesMutex.lock();
-		shouldReloadImages = true;
-		reloadImagesMutex.unlock();
+		enqueueCommand({ RELOAD_IMAGES });
 	}
+	// Size of the image view, the selected image is first decoded at a scale that covers it
+	void setViewSize(int width, int height) { viewWidth = width; viewHeight = height; }
 	float getZoom() { return zoom; }
 	float getAngle() { return angle; }
 	void resetAngle() { angle = 0.0f; }
@@ -102,6 +149,8 @@ public:
 	float getTranslationX() { return translationX; }
 	float getTranslationY() { return translationY; }
 	ImVec2 getTranslation() { return { translationX, translationY }; }
+	// The current view as a value, cutting out the current image's save size
+	ViewTransform getViewTransform();
 
 	void addTranslation(float x, float y) {
 		translationX += x;
@@ -130,23 +179,42 @@ public:
 	void runManagment(std::string imagePath);
 	void stopManagment();
 
+	int getLoaderQueueDepth();
+	unsigned int getCoalescedCommands() { return coalescedCommands; }
+	unsigned int getProcessedCommands() { return processedCommands; }
+	int getPendingDecodes() { return decodePool->getPendingJobs() + decodePool->getActiveJobs(); }
+	unsigned int getDecodeThreadCount() { return decodePool->getThreadCount(); }
+	unsigned int getDecodeGeneration() { return decodePool->getGeneration(); }
+	unsigned int getDroppedDecodes() { return decodePool->getDroppedJobs(); }
+	unsigned int getEmbeddedPreviews() { return embeddedPreviews; }
+	int getUploadQueueDepth() { return uploadQueue->getDepth(); }
+	void setUsePixelBuffers(bool use) { uploadQueue->setUsePixelBuffers(use); }
+	bool getUsePixelBuffers() { return uploadQueue->getUsePixelBuffers(); }
+	double getUploadThroughput(bool pixelBuffers) { return uploadQueue->getThroughput(pixelBuffers); }
+	void setCacheBudgets(size_t textureBudget, size_t pixelBudget) { imageCache->setBudgets(textureBudget, pixelBudget); }
+	ImageCache* getImageCache() { return imageCache; }
+	ThumbnailCache* getThumbnails() { return thumbnails; }
+	SaveService* getSaves() { return saves; }
+
 	void loadCloseImages();
 
 	void setImagesPath(std::string imagePath);
 };
 enum SaveType {
-	PNG = 0, JPG, BMP, BIN
+	PNG = 0, JPG, BMP, BIN, BIN_TILED, BIN_TILED_COMPRESSED
 };
 
-// Can be called in a thread
-void saveImage(Image image, std::string newFilePath = std::string(), int type = PNG, bool transform = false, int quality = 80);
-unsigned char* transformImage(Image* image, unsigned char* data, int* width, int* height, int channels);
-void write_bin(const char* path, int width, int height, int channels, unsigned char* data);
-unsigned char* load_bin(const char* path, int* width, int* height, int* channels);
-
-void flipDataX(int width, int height, unsigned char* data, int channels = 3);
-void flipDataY(int width, int height, unsigned char* data, int channels = 3);
-void rotateData90(int width, int height, unsigned char* data, int channels = 3);
+// Can be called in any number of threads at once, ThreadPool tasks included, blocks until the image is written.
+// getSaves() saves in the background.
+// view is nullptr for a save without the transformation, cache is where to look for already decoded pixels.
+bool saveImage(const Image& image, std::string newFilePath = std::string(), int type = PNG, int quality = 80, const ViewTransform* view = nullptr, ImageCache* cache = nullptr);
+// With maxWidth and maxHeight formats that support it are decoded at a reduced scale still covering that size,
+// fullWidth and fullHeight are then the size at full scale.
+// With tileSource a file too large for one texture that stores its own pyramid is opened as is,
+// only its coarsest level is returned
+ImageDataPtr decodeImage(const std::string& imagePath, int maxWidth = 0, int maxHeight = 0, int* fullWidth = nullptr, int* fullHeight = nullptr, std::shared_ptr<TileSource>* tileSource = nullptr);
+bool check_bin_header(const unsigned char* header, unsigned long long fileSize, int* width, int* height, int* channels);
+ImageDataPtr load_bin(const std::string& path);
 
 void hsvEdit(int width, int height, unsigned char* data, float hue, float saturation, float value, int channels = 3);
 
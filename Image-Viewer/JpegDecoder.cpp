@@ -0,0 +1,196 @@
+#include "JpegDecoder.h"
+#include <cstdio>
+#include <csetjmp>
+#include <fstream>
+#include <algorithm>
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include "stb_image.h"
+#ifdef HAS_LIBJPEG
+#include <jpeglib.h>
+#endif
+
+int JpegDecoder::getCapabilities()
+{
+#ifdef HAS_LIBJPEG
+	return DECODE_SCALED | DECODE_STREAMING | DECODE_EMBEDDED;
+#else
+	return DECODE_EMBEDDED;
+#endif
+}
+
+bool JpegDecoder::sniff(const unsigned char* header, size_t length, unsigned long long fileSize)
+{
+	return length >= 3 && header[0] == 0xFF && header[1] == 0xD8 && header[2] == 0xFF;
+}
+
+ImageDataPtr JpegDecoder::decode(const std::string& imagePath, int maxWidth, int maxHeight, int* fullWidth, int* fullHeight)
+{
+	return decodeJpegScaled(imagePath, maxWidth, maxHeight, fullWidth, fullHeight);
+}
+
+ImageDataPtr JpegDecoder::decodeEmbedded(const std::string& imagePath, int* fullWidth, int* fullHeight)
+{
+	return decodeExifThumbnail(imagePath, fullWidth, fullHeight);
+}
+
+static unsigned int readTiff(const unsigned char* data, bool littleEndian, int bytes)
+{
+	unsigned int value = 0;
+	for (int i = 0; i < bytes; i++)
+		value |= (unsigned int)data[littleEndian ? i : bytes - 1 - i] << (8 * i);
+	return value;
+}
+
+// Offset and length of the IFD1 thumbnail in the TIFF structure of an APP1 Exif segment
+static bool findExifThumbnail(const std::vector<unsigned char>& tiff, size_t& offset, size_t& length)
+{
+	if (tiff.size() < 8 || (tiff[0] != 'I' && tiff[0] != 'M') || tiff[0] != tiff[1])
+		return false;
+	bool littleEndian = tiff[0] == 'I';
+	size_t ifd = readTiff(&tiff[4], littleEndian, 4);
+	if (ifd + 2 > tiff.size())
+		return false;
+	// IFD1 follows the entries of IFD0
+	size_t entries = readTiff(&tiff[ifd], littleEndian, 2);
+	size_t next = ifd + 2 + entries * 12;
+	if (next + 4 > tiff.size())
+		return false;
+	ifd = readTiff(&tiff[next], littleEndian, 4);
+	if (ifd == 0 || ifd + 2 > tiff.size())
+		return false;
+	entries = readTiff(&tiff[ifd], littleEndian, 2);
+	offset = length = 0;
+	for (size_t i = 0; i < entries && ifd + 2 + (i + 1) * 12 <= tiff.size(); i++) {
+		const unsigned char* entry = &tiff[ifd + 2 + i * 12];
+		unsigned int tag = readTiff(entry, littleEndian, 2);
+		unsigned int type = readTiff(entry + 2, littleEndian, 2);
+		unsigned int value = type == 3 ? readTiff(entry + 8, littleEndian, 2) : readTiff(entry + 8, littleEndian, 4);
+		if (tag == 0x0201)
+			offset = value;
+		else if (tag == 0x0202)
+			length = value;
+	}
+	return offset > 0 && length > 0 && offset + length <= tiff.size();
+}
+
+ImageDataPtr decodeExifThumbnail(const std::string& imagePath, int* fullWidth, int* fullHeight)
+{
+	std::ifstream file(imagePath, std::ios::binary);
+	unsigned char marker[4];
+	if (!file.read((char*)marker, 2) || marker[0] != 0xFF || marker[1] != 0xD8)
+		return nullptr;
+
+	// Walk the segments up to the frame header, it has the full size
+	std::vector<unsigned char> exif;
+	int width = 0, height = 0;
+	while (file.read((char*)marker, 4) && marker[0] == 0xFF) {
+		unsigned char type = marker[1];
+		size_t length = (marker[2] << 8 | marker[3]);
+		if (length < 2 || type == 0xDA)
+			break;
+		length -= 2;
+		bool isFrame = type >= 0xC0 && type <= 0xCF && type != 0xC4 && type != 0xC8 && type != 0xCC;
+		if (isFrame) {
+			unsigned char frame[5];
+			if (!file.read((char*)frame, 5))
+				break;
+			height = frame[1] << 8 | frame[2];
+			width = frame[3] << 8 | frame[4];
+			break;
+		}
+		if (type == 0xE1 && exif.empty()) {
+			std::vector<unsigned char> segment(length);
+			if (!file.read((char*)segment.data(), length))
+				break;
+			if (length > 6 && memcmp(segment.data(), "Exif\0\0", 6) == 0)
+				exif.assign(segment.begin() + 6, segment.end());
+			continue;
+		}
+		file.seekg(length, std::ios::cur);
+	}
+
+	size_t offset, length;
+	if (width == 0 || height == 0 || !findExifThumbnail(exif, offset, length))
+		return nullptr;
+	int w, h, channels;
+	unsigned char* data = stbi_load_from_memory(exif.data() + offset, (int)length, &w, &h, &channels, 0);
+	if (data == nullptr)
+		return nullptr;
+	if (std::abs((double)w / h - (double)width / height) > 0.02 * width / height) {
+		stbi_image_free(data);
+		return nullptr;
+	}
+	*fullWidth = width;
+	*fullHeight = height;
+	return std::make_shared<ImageData>(data, w, h, channels, stbi_image_free);
+}
+
+#ifdef HAS_LIBJPEG
+struct JpegError {
+	jpeg_error_mgr manager;
+	jmp_buf jump;
+};
+
+static void jpegErrorExit(j_common_ptr info)
+{
+	longjmp(((JpegError*)info->err)->jump, 1);
+}
+
+ImageDataPtr decodeJpegScaled(const std::string& imagePath, int maxWidth, int maxHeight, int* fullWidth, int* fullHeight)
+{
+	FILE* file = fopen(imagePath.c_str(), "rb");
+	if (file == nullptr)
+		return nullptr;
+
+	jpeg_decompress_struct info;
+	JpegError error;
+	info.err = jpeg_std_error(&error.manager);
+	error.manager.error_exit = jpegErrorExit;
+	// Declared before setjmp, a longjmp must not skip their destruction
+	unsigned char* volatile data = nullptr;
+	if (setjmp(error.jump)) {
+		jpeg_destroy_decompress(&info);
+		fclose(file);
+		delete[] data;
+		return nullptr;
+	}
+	jpeg_create_decompress(&info);
+	jpeg_stdio_src(&info, file);
+	jpeg_read_header(&info, TRUE);
+	*fullWidth = info.image_width;
+	*fullHeight = info.image_height;
+
+	info.out_color_space = info.num_components == 1 ? JCS_GRAYSCALE : JCS_RGB;
+	info.scale_num = 1;
+	info.scale_denom = 1;
+	if (maxWidth > 0 && maxHeight > 0) {
+		double scale = (std::min)((double)maxWidth / info.image_width, (double)maxHeight / info.image_height);
+		for (int denom = 8; denom > 1; denom /= 2) {
+			if (1.0 / denom >= scale) {
+				info.scale_denom = denom;
+				break;
+			}
+		}
+	}
+	info.dct_method = JDCT_ISLOW;
+	jpeg_start_decompress(&info);
+
+	int width = info.output_width, height = info.output_height, channels = info.output_components;
+	data = new unsigned char[(size_t)width * height * channels];
+	while (info.output_scanline < info.output_height) {
+		JSAMPROW row = data + (size_t)info.output_scanline * width * channels;
+		jpeg_read_scanlines(&info, &row, 1);
+	}
+	jpeg_finish_decompress(&info);
+	jpeg_destroy_decompress(&info);
+	fclose(file);
+	return std::make_shared<ImageData>(data, width, height, channels, [](unsigned char* d) { delete[] d; });
+}
+#else
+ImageDataPtr decodeJpegScaled(const std::string& imagePath, int maxWidth, int maxHeight, int* fullWidth, int* fullHeight)
+{
+	return nullptr;
+}
+#endif
@@ -0,0 +1,28 @@
+#pragma once
+#include <string>
+#include "ImageData.h"
+#include "ImageDecoder.h"
+
+#if __has_include(<jpeglib.h>)
+#define HAS_LIBJPEG 1
+#endif
+
+// Decodes at the smallest of 1/1, 1/2, 1/4 or 1/8 scale that still covers maxWidth x maxHeight (aspect kept),
+// the scaling is done by libjpeg in the DCT so the skipped coefficients are never decoded.
+// fullWidth and fullHeight are set to the size of the image at full scale. Returns nullptr when it can't decode the file.
+ImageDataPtr decodeJpegScaled(const std::string& imagePath, int maxWidth, int maxHeight, int* fullWidth, int* fullHeight);
+// The thumbnail stored in the EXIF block (usually 160x120), only the headers are read.
+// Returns nullptr when there is none or it is letterboxed to a different aspect than the image.
+ImageDataPtr decodeExifThumbnail(const std::string& imagePath, int* fullWidth, int* fullHeight);
+
+// Scaled decoding needs libjpeg, the embedded thumbnail is always available
+class JpegDecoder : public ImageDecoder
+{
+public:
+	const char* getName() override { return "libjpeg"; }
+	std::vector<std::string> getExtensions() override { return { ".jpg", ".jpeg" }; }
+	int getCapabilities() override;
+	bool sniff(const unsigned char* header, size_t length, unsigned long long fileSize) override;
+	ImageDataPtr decode(const std::string& imagePath, int maxWidth, int maxHeight, int* fullWidth, int* fullHeight) override;
+	ImageDataPtr decodeEmbedded(const std::string& imagePath, int* fullWidth, int* fullHeight) override;
+};
@@ -0,0 +1,357 @@
+#include "JpegEncoder.h"
+#include <cstring>
+#include <cstdlib>
+
+static const unsigned char naturalOrder[64] = {
+	0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5, 12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51, 58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+// Annex K tables
+static const unsigned char luminanceQuant[64] = {
+	16, 11, 10, 16, 24, 40, 51, 61, 12, 12, 14, 19, 26, 58, 60, 55, 14, 13, 16, 24, 40, 57, 69, 56, 14, 17, 22, 29, 51, 87, 80, 62,
+	18, 22, 37, 56, 68, 109, 103, 77, 24, 35, 55, 64, 81, 104, 113, 92, 49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99
+};
+static const unsigned char chrominanceQuant[64] = {
+	17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99, 24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99
+};
+static const unsigned char dcCounts[2][16] = {
+	{ 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 },
+	{ 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 }
+};
+static const unsigned char dcValues[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+static const unsigned char acCounts[2][16] = {
+	{ 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d },
+	{ 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 }
+};
+static const unsigned char acValues[2][162] = { {
+	0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08,
+	0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+	0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+	0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+	0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6,
+	0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+	0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa
+}, {
+	0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71, 0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
+	0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0, 0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+	0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+	0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+	0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+	0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+	0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa
+} };
+// Output scale of the AAN DCT per row and column
+static const float dctScale[8] = { 1.0f, 1.387039845f, 1.306562965f, 1.175875602f, 1.0f, 0.785694958f, 0.541196100f, 0.275899379f };
+
+// Huffman coded bits with 0xFF bytes stuffed
+struct BitWriter {
+	std::vector<unsigned char>& out;
+	unsigned int buffer = 0;
+	int count = 0;
+
+	void put(unsigned int bits, int length) {
+		buffer = (buffer << length) | (bits & ((1u << length) - 1));
+		count += length;
+		while (count >= 8) {
+			unsigned char byte = buffer >> (count - 8);
+			out.push_back(byte);
+			if (byte == 0xFF)
+				out.push_back(0);
+			count -= 8;
+		}
+		buffer &= (1u << count) - 1;
+	}
+	// Pads the last byte with ones
+	void flush() {
+		if (count > 0)
+			put(0xFF, 8 - count);
+	}
+};
+
+static void buildHuffmanTable(const unsigned char* counts, const unsigned char* values, unsigned short* code, unsigned char* length)
+{
+	int next = 0, k = 0;
+	for (int bits = 1; bits <= 16; bits++) {
+		for (int i = 0; i < counts[bits - 1]; i++, k++) {
+			code[values[k]] = next++;
+			length[values[k]] = bits;
+		}
+		next <<= 1;
+	}
+}
+
+// Scaled float AAN DCT of 8 values step apart
+static void dct8(float* d, int step)
+{
+	float tmp0 = d[0] + d[7 * step], tmp7 = d[0] - d[7 * step];
+	float tmp1 = d[step] + d[6 * step], tmp6 = d[step] - d[6 * step];
+	float tmp2 = d[2 * step] + d[5 * step], tmp5 = d[2 * step] - d[5 * step];
+	float tmp3 = d[3 * step] + d[4 * step], tmp4 = d[3 * step] - d[4 * step];
+
+	float tmp10 = tmp0 + tmp3, tmp13 = tmp0 - tmp3, tmp11 = tmp1 + tmp2, tmp12 = tmp1 - tmp2;
+	d[0] = tmp10 + tmp11;
+	d[4 * step] = tmp10 - tmp11;
+	float z1 = (tmp12 + tmp13) * 0.707106781f;
+	d[2 * step] = tmp13 + z1;
+	d[6 * step] = tmp13 - z1;
+
+	tmp10 = tmp4 + tmp5;
+	tmp11 = tmp5 + tmp6;
+	tmp12 = tmp6 + tmp7;
+	float z5 = (tmp10 - tmp12) * 0.382683433f;
+	float z2 = tmp10 * 0.541196100f + z5;
+	float z4 = tmp12 * 1.306562965f + z5;
+	float z3 = tmp11 * 0.707106781f;
+	float z11 = tmp7 + z3, z13 = tmp7 - z3;
+	d[5 * step] = z13 + z2;
+	d[3 * step] = z13 - z2;
+	d[step] = z11 + z4;
+	d[7 * step] = z11 - z4;
+}
+
+static int bitLength(int value)
+{
+	value = abs(value);
+	int bits = 0;
+	while (value) {
+		bits++;
+		value >>= 1;
+	}
+	return bits;
+}
+
+// block is level shifted, natural order, and is transformed in place
+static void encodeBlock(BitWriter& bits, float* block, const float* divisors, int& dc, const unsigned short* dcCode, const unsigned char* dcLength,
+	const unsigned short* acCode, const unsigned char* acLength)
+{
+	for (int i = 0; i < 8; i++) {
+		dct8(block + i * 8, 1);
+	}
+	for (int i = 0; i < 8; i++) {
+		dct8(block + i, 8);
+	}
+	int quantized[64];
+	for (int k = 0; k < 64; k++) {
+		float value = block[naturalOrder[k]] * divisors[naturalOrder[k]];
+		quantized[k] = (int)(value < 0 ? value - 0.5f : value + 0.5f);
+	}
+
+	int diff = quantized[0] - dc;
+	dc = quantized[0];
+	int size = bitLength(diff);
+	bits.put(dcCode[size], dcLength[size]);
+	if (size)
+		bits.put(diff < 0 ? diff - 1 : diff, size);
+
+	int last = 63;
+	while (last > 0 && quantized[last] == 0)
+		last--;
+	int run = 0;
+	for (int k = 1; k <= last; k++) {
+		if (quantized[k] == 0) {
+			run++;
+			continue;
+		}
+		while (run >= 16) {
+			bits.put(acCode[0xF0], acLength[0xF0]);
+			run -= 16;
+		}
+		size = bitLength(quantized[k]);
+		int symbol = (run << 4) | size;
+		bits.put(acCode[symbol], acLength[symbol]);
+		bits.put(quantized[k] < 0 ? quantized[k] - 1 : quantized[k], size);
+		run = 0;
+	}
+	if (last < 63)
+		bits.put(acCode[0x00], acLength[0x00]);
+}
+
+bool JpegRowWriter::begin(const std::string& path, int width, int height, int channels)
+{
+	if (width > 65535 || height > 65535)
+		return false;
+	file.open(path, std::ios::out | std::ios::binary);
+	if (!file.is_open())
+		return false;
+	this->width = width;
+	this->height = height;
+	this->channels = channels;
+	rowBytes = (size_t)width * channels;
+
+	quality = quality < 1 ? 1 : quality > 100 ? 100 : quality;
+	color = channels >= 3;
+	subsample = color && quality <= 90;
+	mcuSize = subsample ? 16 : 8;
+	mcusPerRow = (width + mcuSize - 1) / mcuSize;
+	mcuRows = (height + mcuSize - 1) / mcuSize;
+
+	int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+	for (int i = 0; i < 64; i++) {
+		const unsigned char* standard[2] = { luminanceQuant, chrominanceQuant };
+		for (int t = 0; t < 2; t++) {
+			int value = (standard[t][i] * scale + 50) / 100;
+			quantTables[t][i] = value < 1 ? 1 : value > 255 ? 255 : value;
+			divisors[t][i] = 1.0f / (quantTables[t][i] * dctScale[i / 8] * dctScale[i % 8] * 8.0f);
+		}
+	}
+	for (int t = 0; t < 2; t++) {
+		buildHuffmanTable(dcCounts[t], dcValues, dcTables[t].code, dcTables[t].length);
+		buildHuffmanTable(acCounts[t], acValues[t], acTables[t].code, acTables[t].length);
+	}
+	writeHeaders();
+	return file.good();
+}
+
+void JpegRowWriter::writeMarker(unsigned char marker, const unsigned char* data, size_t length)
+{
+	unsigned char header[4] = { 0xFF, marker, (unsigned char)((length + 2) >> 8), (unsigned char)(length + 2) };
+	file.write((char*)header, 4);
+	file.write((const char*)data, length);
+}
+
+void JpegRowWriter::writeHeaders()
+{
+	int components = color ? 3 : 1;
+	int tables = color ? 2 : 1;
+	file.write("\xFF\xD8", 2);
+	const unsigned char jfif[14] = { 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0 };
+	writeMarker(0xE0, jfif, sizeof(jfif));
+
+	std::vector<unsigned char> data;
+	for (int t = 0; t < tables; t++) {
+		data.push_back(t);
+		for (int k = 0; k < 64; k++) {
+			data.push_back(quantTables[t][naturalOrder[k]]);
+		}
+	}
+	writeMarker(0xDB, data.data(), data.size());
+
+	data = { 8, (unsigned char)(height >> 8), (unsigned char)height, (unsigned char)(width >> 8), (unsigned char)width, (unsigned char)components };
+	for (int c = 0; c < components; c++) {
+		data.insert(data.end(), { (unsigned char)(c + 1), (unsigned char)(c == 0 && subsample ? 0x22 : 0x11), (unsigned char)(c > 0) });
+	}
+	writeMarker(0xC0, data.data(), data.size());
+
+	data.clear();
+	for (int t = 0; t < tables; t++) {
+		data.push_back(t);
+		data.insert(data.end(), dcCounts[t], dcCounts[t] + 16);
+		data.insert(data.end(), dcValues, dcValues + 12);
+		data.push_back(0x10 | t);
+		data.insert(data.end(), acCounts[t], acCounts[t] + 16);
+		data.insert(data.end(), acValues[t], acValues[t] + 162);
+	}
+	writeMarker(0xC4, data.data(), data.size());
+
+	// One restart interval per MCU row
+	data = { (unsigned char)(mcusPerRow >> 8), (unsigned char)mcusPerRow };
+	writeMarker(0xDD, data.data(), data.size());
+
+	data = { (unsigned char)components };
+	for (int c = 0; c < components; c++) {
+		data.push_back(c + 1);
+		data.push_back(c > 0 ? 0x11 : 0x00);
+	}
+	data.insert(data.end(), { 0, 63, 0 });
+	writeMarker(0xDA, data.data(), data.size());
+}
+
+bool JpegRowWriter::writeRows(const unsigned char* rows, int count)
+{
+	size_t sliceBytes = (size_t)JPEG_SLICE_MCU_ROWS * mcuSize * rowBytes;
+	for (int r = 0; r < count; r++) {
+		pending.insert(pending.end(), rows + r * rowBytes, rows + (r + 1) * rowBytes);
+		if (pending.size() >= sliceBytes)
+			submitSlice();
+	}
+	return slices.drain(false) && file.good();
+}
+
+void JpegRowWriter::submitSlice()
+{
+	std::shared_ptr<Slice> slice = std::make_shared<Slice>();
+	slice->rows.swap(pending);
+	slice->firstMcuRow = nextMcuRow;
+	nextMcuRow += (slice->rows.size() / rowBytes + mcuSize - 1) / mcuSize;
+
+	slices.submit([this, slice] { encodeSlice(slice.get()); }, [this, slice] { return writeSlice(slice.get()); });
+}
+
+void JpegRowWriter::encodeSlice(Slice* slice)
+{
+	int rowCount = slice->rows.size() / rowBytes;
+	int sliceMcuRows = (rowCount + mcuSize - 1) / mcuSize;
+	BitWriter bits = { slice->encoded };
+	float y[256], cb[256], cr[256], block[64];
+	for (int m = 0; m < sliceMcuRows; m++) {
+		int dc[3] = {};
+		for (int mx = 0; mx < mcusPerRow; mx++) {
+			// Pixels past the right and bottom edge repeat the last column and row
+			for (int row = 0; row < mcuSize; row++) {
+				int sourceRow = (std::min)(m * mcuSize + row, rowCount - 1);
+				const unsigned char* line = slice->rows.data() + sourceRow * rowBytes;
+				for (int column = 0; column < mcuSize; column++) {
+					const unsigned char* p = line + (std::min)(mx * mcuSize + column, width - 1) * channels;
+					int i = row * mcuSize + column;
+					if (!color) {
+						y[i] = p[0] - 128.0f;
+						continue;
+					}
+					float r = p[0], g = p[1], b = p[2];
+					y[i] = 0.29900f * r + 0.58700f * g + 0.11400f * b - 128.0f;
+					cb[i] = -0.16874f * r - 0.33126f * g + 0.50000f * b;
+					cr[i] = 0.50000f * r - 0.41869f * g - 0.08131f * b;
+				}
+			}
+			if (!subsample) {
+				encodeBlock(bits, y, divisors[0], dc[0], dcTables[0].code, dcTables[0].length, acTables[0].code, acTables[0].length);
+				if (color) {
+					encodeBlock(bits, cb, divisors[1], dc[1], dcTables[1].code, dcTables[1].length, acTables[1].code, acTables[1].length);
+					encodeBlock(bits, cr, divisors[1], dc[2], dcTables[1].code, dcTables[1].length, acTables[1].code, acTables[1].length);
+				}
+				continue;
+			}
+			for (int by = 0; by < 16; by += 8) {
+				for (int bx = 0; bx < 16; bx += 8) {
+					for (int i = 0; i < 64; i++)
+						block[i] = y[(by + i / 8) * 16 + bx + i % 8];
+					encodeBlock(bits, block, divisors[0], dc[0], dcTables[0].code, dcTables[0].length, acTables[0].code, acTables[0].length);
+				}
+			}
+			float* planes[2] = { cb, cr };
+			for (int c = 0; c < 2; c++) {
+				for (int i = 0; i < 64; i++) {
+					int j = (i / 8) * 32 + (i % 8) * 2;
+					block[i] = (planes[c][j] + planes[c][j + 1] + planes[c][j + 16] + planes[c][j + 17]) * 0.25f;
+				}
+				encodeBlock(bits, block, divisors[1], dc[c + 1], dcTables[1].code, dcTables[1].length, acTables[1].code, acTables[1].length);
+			}
+		}
+		bits.flush();
+		int mcuRow = slice->firstMcuRow + m;
+		if (mcuRow < mcuRows - 1) {
+			slice->encoded.push_back(0xFF);
+			slice->encoded.push_back(0xD0 + mcuRow % 8);
+		}
+	}
+	slice->rows = std::vector<unsigned char>();
+}
+
+bool JpegRowWriter::writeSlice(Slice* slice)
+{
+	file.write((const char*)slice->encoded.data(), slice->encoded.size());
+	return file.good();
+}
+
+bool JpegRowWriter::finish()
+{
+	if (!pending.empty())
+		submitSlice();
+	if (!slices.drain(true))
+		return false;
+	file.write("\xFF\xD9", 2);
+	file.close();
+	return !file.fail();
+}
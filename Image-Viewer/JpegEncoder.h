@@ -0,0 +1,45 @@
+#pragma once
+#include "RowWriter.h"
+
+// MCU rows encoded by one pool task
+#define JPEG_SLICE_MCU_ROWS 4
+
+// Baseline JPEG encoded in slices of MCU rows on the shared ThreadPool.
+// Every MCU row is its own restart interval : the DC prediction starts over and the row ends on a byte boundary
+// with an RST marker, so the slices don't depend on each other and are just concatenated in order.
+// Chroma is subsampled 4:2:0 up to quality 90 like stbi_write_jpg, 1 and 2 channel images are written as grayscale.
+class JpegRowWriter : public RowWriter
+{
+public:
+	JpegRowWriter(int quality) : quality(quality) {}
+	bool begin(const std::string& path, int width, int height, int channels) override;
+	bool writeRows(const unsigned char* rows, int count) override;
+	bool finish() override;
+private:
+	struct HuffmanTable {
+		unsigned short code[256] = {};
+		unsigned char length[256] = {};
+	};
+	struct Slice {
+		std::vector<unsigned char> rows;	// whole MCU rows, the last slice may end early
+		int firstMcuRow = 0;
+		std::vector<unsigned char> encoded;
+	};
+	void submitSlice();
+	void encodeSlice(Slice* slice);
+	bool writeSlice(Slice* slice);
+	void writeHeaders();
+	void writeMarker(unsigned char marker, const unsigned char* data, size_t length);
+
+	std::ofstream file;
+	int quality;
+	int width = 0, height = 0, channels = 0;
+	size_t rowBytes = 0;
+	bool color = true, subsample = true;
+	int mcuSize = 16, mcusPerRow = 0, mcuRows = 0, nextMcuRow = 0;
+	unsigned char quantTables[2][64] = {};	// natural order
+	float divisors[2][64] = {};				// quantization folded with the DCT scale, natural order
+	HuffmanTable dcTables[2], acTables[2];
+	std::vector<unsigned char> pending;
+	OrderedChunks slices;
+};
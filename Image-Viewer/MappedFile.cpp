@@ -0,0 +1,70 @@
+#include "MappedFile.h"
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+std::shared_ptr<MappedFile> MappedFile::open(const std::string& path)
+{
+	std::shared_ptr<MappedFile> mapped(new MappedFile());
+	// Shared for deleting too, so the file can still be replaced or deleted while it is mapped
+	mapped->file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (mapped->file == INVALID_HANDLE_VALUE) {
+		mapped->file = nullptr;
+		return nullptr;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(mapped->file, &size) || size.QuadPart == 0)
+		return nullptr;
+	mapped->size = size.QuadPart;
+	mapped->mapping = CreateFileMappingA(mapped->file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+	if (mapped->mapping == nullptr)
+		return nullptr;
+	mapped->data = (unsigned char*)MapViewOfFile(mapped->mapping, FILE_MAP_COPY, 0, 0, 0);
+	if (mapped->data == nullptr)
+		return nullptr;
+	return mapped;
+}
+
+MappedFile::~MappedFile()
+{
+	if (data != nullptr)
+		UnmapViewOfFile(data);
+	if (mapping != nullptr)
+		CloseHandle(mapping);
+	if (file != nullptr)
+		CloseHandle(file);
+}
+#else
+std::shared_ptr<MappedFile> MappedFile::open(const std::string& path)
+{
+	int file = ::open(path.c_str(), O_RDONLY);
+	if (file < 0)
+		return nullptr;
+	struct stat info;
+	if (fstat(file, &info) != 0 || info.st_size == 0) {
+		close(file);
+		return nullptr;
+	}
+	void* data = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+	close(file);
+	if (data == MAP_FAILED)
+		return nullptr;
+	madvise(data, info.st_size, MADV_SEQUENTIAL);
+	std::shared_ptr<MappedFile> mapped(new MappedFile());
+	mapped->data = (unsigned char*)data;
+	mapped->size = info.st_size;
+	return mapped;
+}
+
+MappedFile::~MappedFile()
+{
+	if (data != nullptr)
+		munmap(data, size);
+}
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+#include <string>
+#include <memory>
+
+// Read only view of a whole file mapped in memory, pages are copy on write so the
+// mapping can be edited in place without touching the file. Unmapped in the destructor.
+class MappedFile
+{
+public:
+	static std::shared_ptr<MappedFile> open(const std::string& path);
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	unsigned char* getData() { return data; }
+	unsigned long long getSize() { return size; }
+private:
+	MappedFile() = default;
+
+	unsigned char* data = nullptr;
+	unsigned long long size = 0;
+#ifdef _WIN32
+	void* file = nullptr;
+	void* mapping = nullptr;
+#endif
+};
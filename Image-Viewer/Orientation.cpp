@@ -0,0 +1,295 @@
+#include "Orientation.h"
+#include "ThreadPool.h"
+#include "CpuFeatures.h"
+#include <cstring>
+#include <algorithm>
+#include <vector>
+
+Orientation imageOrientation(int rotation, bool flipX, bool flipY)
+{
+	const int rotations[4] = { ORIENT_IDENTITY, ORIENT_ROTATE_90, ORIENT_ROTATE_180, ORIENT_ROTATE_270 };
+	// The flips happen on the source, before the rotation, so they reverse the source axes whatever the rotation is
+	int orientation = rotations[(rotation % 4 + 4) % 4];
+	if (flipX)
+		orientation ^= ORIENT_FLIP_X;
+	if (flipY)
+		orientation ^= ORIENT_FLIP_Y;
+	return (Orientation)orientation;
+}
+
+const char* orientationName(Orientation orientation)
+{
+	const char* names[ORIENT_COUNT] = { "Identity", "Flip X", "Flip Y", "Rotate 180", "Transpose", "Rotate 270", "Rotate 90", "Transverse" };
+	return orientation < ORIENT_COUNT ? names[orientation] : "";
+}
+
+OrientationMap orientationMap(Orientation orientation, int sourceWidth, int sourceHeight)
+{
+	OrientationMap map;
+	bool reverseX = orientation & ORIENT_FLIP_X, reverseY = orientation & ORIENT_FLIP_Y;
+	ptrdiff_t stepU = reverseX ? -1 : 1;
+	ptrdiff_t stepV = reverseY ? -(ptrdiff_t)sourceWidth : sourceWidth;
+	map.origin = (reverseY ? (ptrdiff_t)(sourceHeight - 1) * sourceWidth : 0) + (reverseX ? sourceWidth - 1 : 0);
+	if (orientationSwapsAxes(orientation)) {
+		map.stepX = stepV;
+		map.stepY = stepU;
+		map.width = sourceHeight;
+		map.height = sourceWidth;
+	}
+	else {
+		map.stepX = stepU;
+		map.stepY = stepV;
+		map.width = sourceWidth;
+		map.height = sourceHeight;
+	}
+	return map;
+}
+
+// A fixed size copy compiles to a couple of moves instead of a memcpy call per pixel
+template<int C>
+static void copyPixels(const unsigned char* src, ptrdiff_t step, unsigned char* dst, int count, int)
+{
+	for (int x = 0; x < count; x++, src += step * C, dst += C)
+		memcpy(dst, src, C);
+}
+
+template<>
+void copyPixels<0>(const unsigned char* src, ptrdiff_t step, unsigned char* dst, int count, int channels)
+{
+	for (int x = 0; x < count; x++, src += step * channels, dst += channels)
+		memcpy(dst, src, channels);
+}
+
+template<int C>
+static void swapPixels(unsigned char* left, unsigned char* right, int count, int channels)
+{
+	unsigned char pixel[C ? C : 16];
+	for (int x = 0; x < count; x++, left += (C ? C : channels), right -= (C ? C : channels)) {
+		memcpy(pixel, left, C ? C : channels);
+		memcpy(left, right, C ? C : channels);
+		memcpy(right, pixel, C ? C : channels);
+	}
+}
+
+#ifdef HAS_X86_SIMD
+// pshufb masks reversing the pixel order of 48 bytes held in three vectors, 48 is a whole number of pixels for 1 to 4 channels.
+// Output vector k takes byte i of input vector m where mask[k][m][i] is below 0x80.
+template<int C>
+struct ReverseMasks {
+	alignas(16) unsigned char mask[3][3][16];
+	ReverseMasks()
+	{
+		memset(mask, 0x80, sizeof(mask));
+		for (int j = 0; j < 48; j++) {
+			int from = (48 / C - 1 - j / C) * C + j % C;
+			mask[j / 16][from / 16][j % 16] = from % 16;
+		}
+	}
+};
+
+template<int C>
+TARGET_SSSE3 static void loadReverseMasks(__m128i masks[3][3])
+{
+	static const ReverseMasks<C> table;
+	for (int k = 0; k < 3; k++) {
+		for (int m = 0; m < 3; m++)
+			masks[k][m] = _mm_load_si128((const __m128i*)table.mask[k][m]);
+	}
+}
+
+TARGET_SSSE3 static void reverse48(const __m128i in[3], const __m128i masks[3][3], unsigned char* out)
+{
+	for (int k = 0; k < 3; k++) {
+		__m128i result = _mm_shuffle_epi8(in[0], masks[k][0]);
+		result = _mm_or_si128(result, _mm_shuffle_epi8(in[1], masks[k][1]));
+		result = _mm_or_si128(result, _mm_shuffle_epi8(in[2], masks[k][2]));
+		_mm_storeu_si128((__m128i*)(out + k * 16), result);
+	}
+}
+
+TARGET_SSSE3 static void load48(const unsigned char* from, __m128i in[3])
+{
+	for (int m = 0; m < 3; m++)
+		in[m] = _mm_loadu_si128((const __m128i*)(from + m * 16));
+}
+
+template<int C>
+TARGET_SSSE3 static int reverseRowSsse3(const unsigned char* src, unsigned char* dst, int count)
+{
+	const int block = 48 / C;
+	int done = 0;
+	__m128i masks[3][3], in[3];
+	loadReverseMasks<C>(masks);
+	for (; done + block <= count; done += block) {
+		load48(src + (count - done - block) * C, in);
+		reverse48(in, masks, dst + done * C);
+	}
+	return done;
+}
+
+template<int C>
+TARGET_SSSE3 static int flipRowSsse3(unsigned char* row, int count)
+{
+	const int block = 48 / C;
+	int left = 0, right = count;
+	__m128i masks[3][3], leftPixels[3], rightPixels[3];
+	loadReverseMasks<C>(masks);
+	for (; right - left >= 2 * block; left += block, right -= block) {
+		load48(row + left * C, leftPixels);
+		load48(row + (right - block) * C, rightPixels);
+		reverse48(rightPixels, masks, row + left * C);
+		reverse48(leftPixels, masks, row + (right - block) * C);
+	}
+	return left;
+}
+#endif
+
+// count pixels of src into dst in reverse order
+template<int C>
+static void reverseRow(const unsigned char* src, unsigned char* dst, int count, int channels)
+{
+	int done = 0;
+#ifdef HAS_X86_SIMD
+	static const bool ssse3 = cpuHasSsse3();
+	if (C && ssse3)
+		done = reverseRowSsse3<C ? C : 1>(src, dst, count);
+#endif
+	copyPixels<C>(src + (size_t)(count - done - 1) * channels, -1, dst + (size_t)done * channels, count - done, channels);
+}
+
+// Reverses the row in place, whole blocks from both ends at once and what is left in the middle pixel by pixel
+template<int C>
+static void flipRow(unsigned char* row, int count, int channels)
+{
+	int left = 0;
+#ifdef HAS_X86_SIMD
+	static const bool ssse3 = cpuHasSsse3();
+	if (C && ssse3)
+		left = flipRowSsse3<C ? C : 1>(row, count);
+#endif
+	swapPixels<C>(row + (size_t)left * channels, row + (size_t)(count - left - 1) * channels, (count - 2 * left) / 2, channels);
+}
+
+template<int C>
+static void orientTile(const OrientationMap& map, const unsigned char* src, int channels, int x0, int x1, int y0, int y1,
+	unsigned char* dst, int firstRow)
+{
+	if ((x1 - x0) * (y1 - y0) > ORIENT_LEAF_PIXELS) {
+		if (x1 - x0 >= y1 - y0) {
+			int middle = (x0 + x1) / 2;
+			orientTile<C>(map, src, channels, x0, middle, y0, y1, dst, firstRow);
+			orientTile<C>(map, src, channels, middle, x1, y0, y1, dst, firstRow);
+		}
+		else {
+			int middle = (y0 + y1) / 2;
+			orientTile<C>(map, src, channels, x0, x1, y0, middle, dst, firstRow);
+			orientTile<C>(map, src, channels, x0, x1, middle, y1, dst, firstRow);
+		}
+		return;
+	}
+	size_t rowBytes = (size_t)map.width * channels;
+	for (int y = y0; y < y1; y++) {
+		const unsigned char* from = src + (map.origin + x0 * map.stepX + y * map.stepY) * channels;
+		copyPixels<C>(from, map.stepX, dst + (y - firstRow) * rowBytes + (size_t)x0 * channels, x1 - x0, channels);
+	}
+}
+
+template<int C>
+static void orientRowsWith(const OrientationMap& map, const unsigned char* src, int channels, int firstRow, int count, unsigned char* dst)
+{
+	size_t rowBytes = (size_t)map.width * channels;
+	if (map.stepX == 1 || map.stepX == -1) {
+		// A row comes from one source row, reading it in order is already as cache friendly as it gets
+		for (int y = firstRow; y < firstRow + count; y++) {
+			const unsigned char* from = src + (map.origin + y * map.stepY) * channels;
+			if (map.stepX == 1)
+				memcpy(dst + (y - firstRow) * rowBytes, from, rowBytes);
+			else
+				reverseRow<C>(from - (ptrdiff_t)(map.width - 1) * channels, dst + (y - firstRow) * rowBytes, map.width, channels);
+		}
+		return;
+	}
+	orientTile<C>(map, src, channels, 0, map.width, firstRow, firstRow + count, dst, firstRow);
+}
+
+void orientRows(const OrientationMap& map, const unsigned char* src, int channels, int firstRow, int count, unsigned char* dst)
+{
+	switch (channels)
+	{
+	case 1:
+		orientRowsWith<1>(map, src, channels, firstRow, count, dst);
+		break;
+	case 3:
+		orientRowsWith<3>(map, src, channels, firstRow, count, dst);
+		break;
+	case 4:
+		orientRowsWith<4>(map, src, channels, firstRow, count, dst);
+		break;
+	default:
+		orientRowsWith<0>(map, src, channels, firstRow, count, dst);
+		break;
+	}
+}
+
+void orientData(Orientation orientation, int width, int height, const unsigned char* src, unsigned char* dst, int channels)
+{
+	OrientationMap map = orientationMap(orientation, width, height);
+	ThreadPool* pool = ThreadPool::getInstance();
+	// A few bands per thread so a slow one doesn't hold up the rest
+	int tasks = pool->getThreadCount() * 4;
+	int rows = (map.height + tasks - 1) / tasks;
+	rows = (std::max)(rows, ORIENT_MIN_TASK_ROWS);
+	int bands = (map.height + rows - 1) / rows;
+	size_t rowBytes = (size_t)map.width * channels;
+	pool->parallelFor(bands, [&](int band) {
+		int firstRow = band * rows;
+		orientRows(map, src, channels, firstRow, (std::min)(rows, map.height - firstRow), dst + firstRow * rowBytes);
+	});
+}
+
+void flipDataX(int width, int height, unsigned char* data, int channels)
+{
+	size_t rowBytes = (size_t)width * channels;
+	for (int y = 0; y < height; y++) {
+		unsigned char* row = data + y * rowBytes;
+		switch (channels)
+		{
+		case 1:
+			flipRow<1>(row, width, channels);
+			break;
+		case 3:
+			flipRow<3>(row, width, channels);
+			break;
+		case 4:
+			flipRow<4>(row, width, channels);
+			break;
+		default:
+			flipRow<0>(row, width, channels);
+			break;
+		}
+	}
+}
+
+void flipDataY(int width, int height, unsigned char* data, int channels)
+{
+	// Whole rows swap through a small buffer, wide copies whatever the channel count is
+	unsigned char buffer[4096];
+	size_t rowBytes = (size_t)width * channels;
+	for (int y = 0; y < height / 2; y++) {
+		unsigned char* top = data + y * rowBytes;
+		unsigned char* bottom = data + (height - 1 - y) * rowBytes;
+		for (size_t offset = 0; offset < rowBytes; offset += sizeof(buffer)) {
+			size_t bytes = (std::min)(sizeof(buffer), rowBytes - offset);
+			memcpy(buffer, top + offset, bytes);
+			memcpy(top + offset, bottom + offset, bytes);
+			memcpy(bottom + offset, buffer, bytes);
+		}
+	}
+}
+
+void rotateData90(int width, int height, unsigned char* data, int channels)
+{
+	std::vector<unsigned char> rotated((size_t)width * height * channels);
+	orientData(ORIENT_ROTATE_90, width, height, data, rotated.data(), channels);
+	memcpy(data, rotated.data(), rotated.size());
+}
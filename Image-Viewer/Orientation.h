@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+
+// Output pixels copied per leaf of the recursive split when the axes are swapped, 32 x 32 pixels
+#define ORIENT_LEAF_PIXELS 1024
+// Output rows one pool task orients at least
+#define ORIENT_MIN_TASK_ROWS 64
+
+// The eight ways to lay out an image without resampling.
+// Bit 1 reverses the source x, bit 2 the source y and bit 4 swaps the axes, output x walks the source y.
+enum Orientation {
+	ORIENT_IDENTITY = 0,
+	ORIENT_FLIP_X = 1,
+	ORIENT_FLIP_Y = 2,
+	ORIENT_ROTATE_180 = 3,
+	ORIENT_TRANSPOSE = 4,
+	ORIENT_ROTATE_270 = 5,
+	ORIENT_ROTATE_90 = 6,
+	ORIENT_TRANSVERSE = 7,
+	ORIENT_COUNT
+};
+
+// The orientation an Image is shown in : the source flipped, then rotated by rotation clockwise quarter turns
+Orientation imageOrientation(int rotation, bool flipX, bool flipY);
+inline bool orientationSwapsAxes(Orientation orientation) { return orientation & ORIENT_TRANSPOSE; }
+const char* orientationName(Orientation orientation);
+
+// The source index of output pixel (x, y) is origin + x * stepX + y * stepY, in pixels
+struct OrientationMap {
+	ptrdiff_t origin = 0, stepX = 1, stepY = 0;
+	int width = 0, height = 0;	// output size
+};
+OrientationMap orientationMap(Orientation orientation, int sourceWidth, int sourceHeight);
+
+// Output rows [firstRow, firstRow + count) into dst, width * channels bytes per row.
+// Swapped axes are copied in tiles found by halving the area until it fits a leaf, so reads and writes stay in cache at any size.
+void orientRows(const OrientationMap& map, const unsigned char* src, int channels, int firstRow, int count, unsigned char* dst);
+// The whole image into dst, which must not overlap src. Runs in bands of rows on the ThreadPool.
+void orientData(Orientation orientation, int width, int height, const unsigned char* src, unsigned char* dst, int channels = 3);
+
+// In place, for callers that hold a single buffer. The flips reverse rows with SSSE3 shuffles when the CPU has them.
+void flipDataX(int width, int height, unsigned char* data, int channels = 3);
+void flipDataY(int width, int height, unsigned char* data, int channels = 3);
+void rotateData90(int width, int height, unsigned char* data, int channels = 3);
@@ -0,0 +1,89 @@
+#include "PixelBufferRing.h"
+
+PixelBufferRing::PixelBufferRing(size_t slotSize, unsigned int slotCount)
+{
+	this->slotSize = slotSize;
+	slots.resize(slotCount);
+}
+
+bool PixelBufferRing::create()
+{
+	persistent = false;
+#ifdef GL_VERSION_4_4
+	persistent = persistent || GLAD_GL_VERSION_4_4;
+#endif
+#ifdef GL_ARB_buffer_storage
+	persistent = persistent || GLAD_GL_ARB_buffer_storage;
+#endif
+	for (Slot& slot : slots) {
+		glGenBuffers(1, &slot.buffer);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+#if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+		if (persistent) {
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_PIXEL_UNPACK_BUFFER, slotSize, nullptr, flags);
+			slot.mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, slotSize, flags);
+			if (slot.mapped == nullptr) {
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+				destroy();
+				return false;
+			}
+			continue;
+		}
+#endif
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, slotSize, nullptr, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	return true;
+}
+
+void PixelBufferRing::destroy()
+{
+	for (Slot& slot : slots) {
+		if (slot.fence != nullptr)
+			glDeleteSync(slot.fence);
+		if (slot.mapped != nullptr) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		}
+		if (slot.buffer != 0)
+			glDeleteBuffers(1, &slot.buffer);
+		slot = Slot();
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+PixelBufferStatus PixelBufferRing::acquire(unsigned char*& mapped)
+{
+	mapped = nullptr;
+	Slot& slot = slots[next];
+	if (slot.fence != nullptr) {
+		if (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED)
+			return PIXEL_BUFFER_BUSY;
+		glDeleteSync(slot.fence);
+		slot.fence = nullptr;
+	}
+	if (persistent) {
+		mapped = slot.mapped;
+		return PIXEL_BUFFER_READY;
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+	mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, slotSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (mapped == nullptr) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return PIXEL_BUFFER_FAILED;
+	}
+	return PIXEL_BUFFER_READY;
+}
+
+void PixelBufferRing::upload(int x, int y, int width, int height, GLenum format)
+{
+	Slot& slot = slots[next];
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+	if (!persistent)
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, format, GL_UNSIGNED_BYTE, nullptr);
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	next = (next + 1) % slots.size();
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <glad/glad.h>
+#include <vector>
+
+#define PIXEL_BUFFER_SLOTS 8
+
+enum PixelBufferStatus {
+	PIXEL_BUFFER_READY = 0, PIXEL_BUFFER_BUSY, PIXEL_BUFFER_FAILED
+};
+
+// Ring of pixel unpack buffers used to stream texture data.
+// When GL 4.4 / ARB_buffer_storage is available the buffers are persistently mapped, otherwise every
+// acquire maps the slot unsynchronized. A fence after each upload tells when the slot can be written again.
+// Only to be used on the render thread, destroy releases the GL objects while the context is current.
+class PixelBufferRing
+{
+public:
+	PixelBufferRing(size_t slotSize, unsigned int slotCount = PIXEL_BUFFER_SLOTS);
+	~PixelBufferRing() {}
+
+	bool create();
+	void destroy();
+
+	// Mapped memory of the next slot in mapped. PIXEL_BUFFER_BUSY while the GPU is still reading from it,
+	// PIXEL_BUFFER_FAILED when the slot can't be mapped, the ring is of no use then.
+	PixelBufferStatus acquire(unsigned char*& mapped);
+	// Uploads the slot returned by the last acquire into the texture bound to GL_TEXTURE_2D
+	void upload(int x, int y, int width, int height, GLenum format);
+
+	bool isPersistent() { return persistent; }
+	size_t getSlotSize() { return slotSize; }
+private:
+	struct Slot {
+		unsigned int buffer = 0;
+		unsigned char* mapped = nullptr;
+		GLsync fence = nullptr;
+	};
+	std::vector<Slot> slots;
+	size_t slotSize;
+	unsigned int next = 0;
+	bool persistent = false;
+};
@@ -0,0 +1,387 @@
+#include "RowWriter.h"
+#include "ImageManagment.h"
+#include "BinFormat.h"
+#include "ThreadPool.h"
+#include "JpegEncoder.h"
+#include <cstring>
+#include <cstdlib>
+
+std::unique_ptr<RowWriter> createRowWriter(int type, int quality, int compression)
+{
+	switch (type)
+	{
+	case PNG:
+#ifdef HAS_ZLIB
+		return std::make_unique<PngRowWriter>(compression);
+#else
+		return std::make_unique<BufferedRowWriter>(type, quality);
+#endif
+	case JPG:
+		return std::make_unique<JpegRowWriter>(quality);
+	case BMP:
+		return std::make_unique<BmpRowWriter>();
+	case BIN:
+		return std::make_unique<BinRowWriter>();
+	default:
+		return std::make_unique<BufferedRowWriter>(type, quality);
+	}
+}
+
+OrderedChunks::~OrderedChunks()
+{
+	// The pool may still be working on chunks of an abandoned save
+	for (Entry& entry : entries) {
+		ThreadPool::getInstance()->wait(entry.done);
+	}
+}
+
+void OrderedChunks::submit(std::function<void()> encode, std::function<bool()> write)
+{
+	entries.push_back({ ThreadPool::getInstance()->submit(std::move(encode)), std::move(write) });
+}
+
+bool OrderedChunks::drain(bool all)
+{
+	while (!entries.empty()) {
+		Entry& entry = entries.front();
+		if (!all && entries.size() <= 2 * ThreadPool::getInstance()->getThreadCount() && entry.done.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			break;
+		ThreadPool::getInstance()->wait(entry.done);
+		if (!entry.write())
+			return false;
+		entries.pop_front();
+	}
+	return true;
+}
+
+static void writeBigEndian(unsigned char* out, unsigned int value)
+{
+	out[0] = value >> 24;
+	out[1] = value >> 16;
+	out[2] = value >> 8;
+	out[3] = value;
+}
+
+#ifdef HAS_ZLIB
+// The filter with the smallest sum of absolute differences, the same heuristic as libpng and stb.
+// previous is nullptr for the first row of the image.
+static void filterRow(const unsigned char* row, const unsigned char* previous, size_t rowBytes, int channels, unsigned char* out, unsigned char* candidate)
+{
+	unsigned int bestSum = -1;
+	for (int filter = 0; filter < 5; filter++) {
+		candidate[0] = filter;
+		unsigned int sum = 0;
+		for (size_t i = 0; i < rowBytes; i++) {
+			int left = i >= channels ? row[i - channels] : 0;
+			int up = previous ? previous[i] : 0;
+			int upLeft = previous && i >= channels ? previous[i - channels] : 0;
+			int predicted = 0;
+			switch (filter) {
+			case 1: predicted = left; break;
+			case 2: predicted = up; break;
+			case 3: predicted = (left + up) >> 1; break;
+			case 4: {
+				int p = left + up - upLeft, pa = abs(p - left), pb = abs(p - up), pc = abs(p - upLeft);
+				predicted = pa <= pb && pa <= pc ? left : pb <= pc ? up : upLeft;
+				break;
+			}
+			}
+			unsigned char value = row[i] - predicted;
+			candidate[i + 1] = value;
+			sum += abs((signed char)value);
+		}
+		if (sum < bestSum) {
+			bestSum = sum;
+			memcpy(out, candidate, rowBytes + 1);
+		}
+	}
+}
+
+bool PngRowWriter::begin(const std::string& path, int width, int height, int channels)
+{
+	file.open(path, std::ios::out | std::ios::binary);
+	if (!file.is_open())
+		return false;
+	this->width = width;
+	this->channels = channels;
+	rowBytes = (size_t)width * channels;
+	chunkRows = (std::max)(1, (int)(PNG_CHUNK_BYTES / rowBytes));
+	// Enough rows before a chunk to fill the 32 kB window, plus the one the first of them is predicted from
+	contextRows = (int)((32768 + rowBytes) / (rowBytes + 1)) + 1;
+
+	const unsigned char colorTypes[5] = { 0, 0, 4, 2, 6 };
+	unsigned char header[13] = {};
+	writeBigEndian(header, width);
+	writeBigEndian(header + 4, height);
+	header[8] = 8;
+	header[9] = colorTypes[channels];
+	file.write("\x89PNG\r\n\x1a\n", 8);
+	writeChunk("IHDR", header, 13);
+
+	// zlib header, the chunks are raw deflate streams
+	unsigned char zlibHeader[2] = { 0x78, (unsigned char)((level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3) << 6) };
+	zlibHeader[1] += 31 - (zlibHeader[0] * 256 + zlibHeader[1]) % 31;
+	writeData(zlibHeader, 2);
+	return file.good();
+}
+
+bool PngRowWriter::writeRows(const unsigned char* rows, int count)
+{
+	for (int r = 0; r < count; r++) {
+		pending.insert(pending.end(), rows + r * rowBytes, rows + (r + 1) * rowBytes);
+		if (pending.size() >= chunkRows * rowBytes)
+			submitChunk(false);
+	}
+	return chunks.drain(false) && file.good();
+}
+
+void PngRowWriter::submitChunk(bool last)
+{
+	std::shared_ptr<Chunk> chunk = std::make_shared<Chunk>();
+	chunk->contextRows = context.size() / rowBytes;
+	chunk->rows.reserve(context.size() + pending.size());
+	chunk->rows.insert(chunk->rows.end(), context.begin(), context.end());
+	chunk->rows.insert(chunk->rows.end(), pending.begin(), pending.end());
+	chunk->last = last;
+
+	size_t keep = (std::min)(chunk->rows.size(), contextRows * rowBytes);
+	context.assign(chunk->rows.end() - keep, chunk->rows.end());
+	pending.clear();
+
+	chunks.submit([this, chunk] { deflateChunk(chunk.get()); }, [this, chunk] { return writeChunkData(chunk.get()); });
+}
+
+void PngRowWriter::deflateChunk(Chunk* chunk)
+{
+	int rowCount = chunk->rows.size() / rowBytes;
+	size_t filteredRow = rowBytes + 1;
+	// The first context row is only there to predict the next one from
+	int first = chunk->contextRows > 0 ? 1 : 0;
+	std::vector<unsigned char> filtered((size_t)(rowCount - first) * filteredRow);
+	std::vector<unsigned char> candidate(filteredRow);
+	for (int i = first; i < rowCount; i++) {
+		const unsigned char* row = chunk->rows.data() + i * rowBytes;
+		filterRow(row, i > 0 ? row - rowBytes : nullptr, rowBytes, channels, filtered.data() + (i - first) * filteredRow, candidate.data());
+	}
+	size_t dictionaryBytes = (size_t)(chunk->contextRows - first) * filteredRow;
+	size_t dictionaryStart = dictionaryBytes > 32768 ? dictionaryBytes - 32768 : 0;
+	unsigned char* input = filtered.data() + dictionaryBytes;
+	chunk->filteredBytes = filtered.size() - dictionaryBytes;
+	chunk->adler = adler32(1, input, chunk->filteredBytes);
+
+	z_stream stream = {};
+	if (deflateInit2(&stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		chunk->failed = true;
+		return;
+	}
+	if (dictionaryBytes > dictionaryStart)
+		deflateSetDictionary(&stream, filtered.data() + dictionaryStart, dictionaryBytes - dictionaryStart);
+	// The sync flush ends the chunk on a byte boundary without ending the stream, only the last chunk finishes it
+	int flush = chunk->last ? Z_FINISH : Z_SYNC_FLUSH;
+	chunk->deflated.resize(deflateBound(&stream, chunk->filteredBytes) + 16);
+	stream.next_in = input;
+	stream.avail_in = chunk->filteredBytes;
+	stream.next_out = chunk->deflated.data();
+	stream.avail_out = chunk->deflated.size();
+	while (true) {
+		int result = deflate(&stream, flush);
+		if (result == Z_STREAM_ERROR) {
+			chunk->failed = true;
+			break;
+		}
+		if (result == Z_STREAM_END || (flush == Z_SYNC_FLUSH && stream.avail_in == 0 && stream.avail_out > 0))
+			break;
+		if (stream.avail_out == 0) {
+			size_t used = chunk->deflated.size();
+			chunk->deflated.resize(used * 2);
+			stream.next_out = chunk->deflated.data() + used;
+			stream.avail_out = chunk->deflated.size() - used;
+		}
+	}
+	chunk->deflated.resize(chunk->deflated.size() - stream.avail_out);
+	deflateEnd(&stream);
+	chunk->rows = std::vector<unsigned char>();
+}
+
+bool PngRowWriter::writeChunkData(Chunk* chunk)
+{
+	if (chunk->failed)
+		return false;
+	writeData(chunk->deflated.data(), chunk->deflated.size());
+	adler = adler32_combine(adler, chunk->adler, chunk->filteredBytes);
+	return file.good();
+}
+
+// Collects the zlib stream into IDAT chunks of PNG_IDAT_BYTES
+void PngRowWriter::writeData(const unsigned char* data, size_t length)
+{
+	idat.insert(idat.end(), data, data + length);
+	size_t written = 0;
+	while (idat.size() - written >= PNG_IDAT_BYTES) {
+		writeChunk("IDAT", idat.data() + written, PNG_IDAT_BYTES);
+		written += PNG_IDAT_BYTES;
+	}
+	idat.erase(idat.begin(), idat.begin() + written);
+}
+
+bool PngRowWriter::finish()
+{
+	submitChunk(true);
+	if (!chunks.drain(true))
+		return false;
+	unsigned char trailer[4];
+	writeBigEndian(trailer, adler);
+	writeData(trailer, 4);
+	if (!idat.empty())
+		writeChunk("IDAT", idat.data(), idat.size());
+	writeChunk("IEND", nullptr, 0);
+	file.close();
+	return !file.fail();
+}
+
+void PngRowWriter::writeChunk(const char* type, const unsigned char* data, size_t length)
+{
+	unsigned char bytes[4];
+	writeBigEndian(bytes, length);
+	file.write((char*)bytes, 4);
+	file.write(type, 4);
+	if (length > 0)
+		file.write((const char*)data, length);
+	uLong crc = crc32(0, (const Bytef*)type, 4);
+	if (length > 0)
+		crc = crc32(crc, data, length);
+	writeBigEndian(bytes, crc);
+	file.write((char*)bytes, 4);
+}
+#endif
+
+// Same layout as stbi_write_bmp : 24 bits, or 32 bits with a V4 header and alpha mask for 4 channels
+bool BmpRowWriter::begin(const std::string& path, int width, int height, int channels)
+{
+	file.open(path, std::ios::out | std::ios::binary);
+	if (!file.is_open())
+		return false;
+	this->width = width;
+	this->height = height;
+	this->channels = channels;
+	bool alpha = channels == 4;
+	stride = alpha ? (size_t)width * 4 : ((size_t)width * 3 + 3) & ~(size_t)3;
+	headerSize = alpha ? 14 + 108 : 14 + 40;
+	converted.assign(stride, 0);
+
+	std::vector<unsigned char> header(headerSize, 0);
+	auto put = [&header](size_t offset, unsigned int value, int bytes) {
+		for (int i = 0; i < bytes; i++)
+			header[offset + i] = value >> (8 * i);
+	};
+	header[0] = 'B';
+	header[1] = 'M';
+	put(2, headerSize + stride * height, 4);
+	put(10, headerSize, 4);
+	put(14, headerSize - 14, 4);
+	put(18, width, 4);
+	put(22, height, 4);
+	put(26, 1, 2);
+	put(28, alpha ? 32 : 24, 2);
+	if (alpha) {
+		put(30, 3, 4);
+		put(54, 0xff0000, 4);
+		put(58, 0xff00, 4);
+		put(62, 0xff, 4);
+		put(66, 0xff000000u, 4);
+	}
+	file.write((char*)header.data(), headerSize);
+	return file.good();
+}
+
+bool BmpRowWriter::writeRows(const unsigned char* rows, int count)
+{
+	for (int r = 0; r < count; r++, row++) {
+		const unsigned char* src = rows + (size_t)r * width * channels;
+		unsigned char* dst = converted.data();
+		for (int x = 0; x < width; x++, src += channels) {
+			if (channels >= 3) {
+				*dst++ = src[2];
+				*dst++ = src[1];
+				*dst++ = src[0];
+				if (channels == 4)
+					*dst++ = src[3];
+			}
+			else {
+				*dst++ = src[0];
+				*dst++ = src[0];
+				*dst++ = src[0];
+			}
+		}
+		file.seekp(headerSize + (size_t)(height - 1 - row) * stride);
+		file.write((char*)converted.data(), stride);
+	}
+	return file.good();
+}
+
+bool BmpRowWriter::finish()
+{
+	file.close();
+	return !file.fail();
+}
+
+bool BinRowWriter::begin(const std::string& path, int width, int height, int channels)
+{
+	file.open(path, std::ios::out | std::ios::binary);
+	if (!file.is_open())
+		return false;
+	rowBytes = (size_t)width * channels;
+	//	resolution x(4 bajta)	- rezolucija slike x(recimo 1920)
+	//	resolution y(4 bajta)	- rezolucija slike y(recimo 1080)
+	//	type(4 bajta)			- tip(0 inicijalno)
+	//	rgb(4 bajta)			- 0 za 24 bita, 1 za 32 bita rgb
+	//	xor (4 bajta)			- tip kodiranja - sifriranja piksela(ako je 0 nema kodiranja)
+	//	len(4 bajta)			- ukupna duzina fajla(ukljucujuci i ovaj header duzine 24 bajta)
+	unsigned int header[6] = { (unsigned int)width, (unsigned int)height, BIN_TYPE_FLAT, (unsigned int)channels, 0, (unsigned int)(24 + rowBytes * height) };
+	file.write((char*)header, sizeof(header));
+	return file.good();
+}
+
+bool BinRowWriter::writeRows(const unsigned char* rows, int count)
+{
+	file.write((const char*)rows, rowBytes * count);
+	return file.good();
+}
+
+bool BinRowWriter::finish()
+{
+	file.close();
+	return !file.fail();
+}
+
+bool BufferedRowWriter::begin(const std::string& path, int width, int height, int channels)
+{
+	this->path = path;
+	this->width = width;
+	this->height = height;
+	this->channels = channels;
+	pixels.resize((size_t)width * height * channels);
+	return true;
+}
+
+bool BufferedRowWriter::writeRows(const unsigned char* rows, int count)
+{
+	size_t bytes = (size_t)width * channels * count;
+	memcpy(pixels.data() + written, rows, bytes);
+	written += bytes;
+	return true;
+}
+
+bool BufferedRowWriter::finish()
+{
+	switch (type)
+	{
+	case PNG:
+		return stbi_write_png(path.c_str(), width, height, channels, pixels.data(), width * channels);
+	case BIN_TILED:
+	case BIN_TILED_COMPRESSED:
+		return write_bin_tiled(path.c_str(), width, height, channels, pixels.data(), type == BIN_TILED_COMPRESSED);
+	default:
+		return false;
+	}
+}
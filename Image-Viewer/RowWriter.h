@@ -0,0 +1,133 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <fstream>
+#include <memory>
+#include <deque>
+#include <future>
+#include <functional>
+
+#if __has_include(<zlib.h>)
+#include <zlib.h>
+#define HAS_ZLIB 1
+#endif
+
+#define PNG_COMPRESSION_LEVEL 6
+#define PNG_IDAT_BYTES (64 * 1024)
+#define PNG_CHUNK_BYTES (256 * 1024)
+
+// Encodes an image handed over a band of rows at a time, top to bottom.
+// Formats that can't be written in strips keep the rows until finish.
+class RowWriter
+{
+public:
+	virtual ~RowWriter() {}
+	virtual bool begin(const std::string& path, int width, int height, int channels) = 0;
+	// count rows of width * channels bytes each
+	virtual bool writeRows(const unsigned char* rows, int count) = 0;
+	virtual bool finish() = 0;
+};
+
+// Chunks of an image encoded on the shared ThreadPool and written out in the order they were submitted.
+// The encode step runs on the pool, the write step on the thread calling drain, oldest chunk first.
+// Declare it after everything the encode step reads, it waits for the pool when destroyed.
+class OrderedChunks
+{
+public:
+	~OrderedChunks();
+	void submit(std::function<void()> encode, std::function<bool()> write);
+	// Writes the oldest chunks as soon as they are done, at most two per thread are left in flight.
+	// With all set every chunk is waited for. Returns false when a write fails.
+	bool drain(bool all);
+private:
+	struct Entry {
+		std::future<void> done;
+		std::function<bool()> write;
+	};
+	std::deque<Entry> entries;
+};
+
+// type is a SaveType, quality only matters for JPG and compression (zlib level 0 - 9) for PNG
+std::unique_ptr<RowWriter> createRowWriter(int type, int quality, int compression = PNG_COMPRESSION_LEVEL);
+
+#ifdef HAS_ZLIB
+// Rows are filtered and deflated in chunks of about PNG_CHUNK_BYTES on the shared ThreadPool, the way pigz does it :
+// every chunk is a raw deflate stream primed with the last 32 kB before it and ended with a sync flush,
+// so the pieces concatenate into one zlib stream. The adler32 of the whole stream is combined from the chunks.
+class PngRowWriter : public RowWriter
+{
+public:
+	PngRowWriter(int level = PNG_COMPRESSION_LEVEL) : level(level) {}
+	bool begin(const std::string& path, int width, int height, int channels) override;
+	bool writeRows(const unsigned char* rows, int count) override;
+	bool finish() override;
+private:
+	struct Chunk {
+		// Raw rows, the first contextRows of them come before the chunk and only prime the dictionary
+		std::vector<unsigned char> rows;
+		int contextRows = 0;
+		bool last = false;
+		std::vector<unsigned char> deflated;
+		uLong adler = 1;
+		size_t filteredBytes = 0;
+		bool failed = false;
+	};
+	void submitChunk(bool last);
+	void deflateChunk(Chunk* chunk);
+	bool writeChunkData(Chunk* chunk);
+	void writeData(const unsigned char* data, size_t length);
+	void writeChunk(const char* type, const unsigned char* data, size_t length);
+
+	std::ofstream file;
+	int level;
+	int width = 0, channels = 0;
+	size_t rowBytes = 0;
+	int chunkRows = 0, contextRows = 0;
+	std::vector<unsigned char> pending, context;
+	std::vector<unsigned char> idat;
+	uLong adler = 1;
+	OrderedChunks chunks;
+};
+#endif
+
+// Rows are stored bottom up, every row is written to its final place in the file
+class BmpRowWriter : public RowWriter
+{
+public:
+	bool begin(const std::string& path, int width, int height, int channels) override;
+	bool writeRows(const unsigned char* rows, int count) override;
+	bool finish() override;
+private:
+	std::ofstream file;
+	int width = 0, height = 0, channels = 0, row = 0;
+	size_t headerSize = 0, stride = 0;
+	std::vector<unsigned char> converted;
+};
+
+// Flat .bin
+class BinRowWriter : public RowWriter
+{
+public:
+	bool begin(const std::string& path, int width, int height, int channels) override;
+	bool writeRows(const unsigned char* rows, int count) override;
+	bool finish() override;
+private:
+	std::ofstream file;
+	size_t rowBytes = 0;
+};
+
+// Collects the whole image for the encoders that need it at once (tiled .bin, PNG without zlib)
+class BufferedRowWriter : public RowWriter
+{
+public:
+	BufferedRowWriter(int type, int quality) : type(type), quality(quality) {}
+	bool begin(const std::string& path, int width, int height, int channels) override;
+	bool writeRows(const unsigned char* rows, int count) override;
+	bool finish() override;
+private:
+	int type, quality;
+	std::string path;
+	int width = 0, height = 0, channels = 0;
+	std::vector<unsigned char> pixels;
+	size_t written = 0;
+};
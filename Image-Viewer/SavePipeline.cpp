@@ -0,0 +1,84 @@
+#include "SavePipeline.h"
+#include "ImageManagment.h"
+#include "ThreadPool.h"
+#include <cstring>
+#include <cmath>
+
+SaveGeometry compileSaveGeometry(const Image& image, int sourceWidth, int sourceHeight, bool transform, const ViewTransform& view)
+{
+	SaveGeometry geometry;
+	Orientation orientation = imageOrientation(image.rotation, image.flipX, image.flipY);
+	geometry.orientation = orientationMap(orientation, sourceWidth, sourceHeight);
+	geometry.width = geometry.orientation.width;
+	geometry.height = geometry.orientation.height;
+	geometry.transform = transform;
+
+	// Output pixel centers into the oriented image, in the order the view has always been applied :
+	// the translation, the rotation around the middle of the output and then the zoom
+	double oriented[2][3] = { { 1, 0, 0.5 }, { 0, 1, 0.5 } };
+	if (transform) {
+		int orientedWidth = geometry.width, orientedHeight = geometry.height;
+		geometry.width = view.width > 0 ? view.width : orientedWidth;
+		geometry.height = view.height > 0 ? view.height : orientedHeight;
+		double cosA = cos(-view.angle), sinA = sin(-view.angle), zoom = 1.0 / view.zoom;
+		double offsetX = 0.5 - geometry.width / 2.0 - view.translationX * orientedWidth;
+		double offsetY = 0.5 - geometry.height / 2.0 - view.translationY * orientedHeight;
+		oriented[0][0] = zoom * cosA;
+		oriented[0][1] = -zoom * sinA;
+		oriented[0][2] = zoom * (cosA * offsetX - sinA * offsetY) + orientedWidth / 2.0;
+		oriented[1][0] = zoom * sinA;
+		oriented[1][1] = zoom * cosA;
+		oriented[1][2] = zoom * (sinA * offsetX + cosA * offsetY) + orientedHeight / 2.0;
+	}
+
+	// Centers on a pixel edge would round to different pixels once an axis is reversed, nudged off the edge
+	// they pick the same pixel whether the orientation is applied before or together with the view
+	oriented[0][2] += 1.0 / 1024;
+	oriented[1][2] += 1.0 / 1024;
+
+	// Then through the orientation into the source, a reversed axis measures from the far edge
+	bool swap = orientationSwapsAxes(orientation);
+	const double* u = oriented[swap ? 1 : 0];
+	const double* v = oriented[swap ? 0 : 1];
+	bool reverseX = orientation & ORIENT_FLIP_X, reverseY = orientation & ORIENT_FLIP_Y;
+	for (int i = 0; i < 3; i++) {
+		geometry.map.mapX[i] = reverseX ? -u[i] : u[i];
+		geometry.map.mapY[i] = reverseY ? -v[i] : v[i];
+	}
+	if (reverseX)
+		geometry.map.mapX[2] += sourceWidth;
+	if (reverseY)
+		geometry.map.mapY[2] += sourceHeight;
+	return geometry;
+}
+
+SaveBandSource::SaveBandSource(const Image& image, ImageDataPtr source, bool transform, const ViewTransform& view, bool adjustColour)
+{
+	this->source = source;
+	filter = view.filter;
+	geometry = compileSaveGeometry(image, source->width, source->height, transform, view);
+
+	this->adjustColour = adjustColour && source->channels >= 3
+		&& (image.mod.saturation != 1.0 || image.mod.brightness != 1.0 || image.mod.hue != 0.0);
+	hue = image.mod.hue;
+	saturation = image.mod.saturation;
+	brightness = image.mod.brightness;
+}
+
+void SaveBandSource::readRows(int y, int count, unsigned char* out)
+{
+	int channels = source->channels;
+	size_t rowBytes = (size_t)geometry.width * channels;
+	int groups = (count + SAVE_FUSED_ROWS - 1) / SAVE_FUSED_ROWS;
+	ThreadPool::getInstance()->parallelFor(groups, [&](int group) {
+		int row = y + group * SAVE_FUSED_ROWS;
+		int rows = (std::min)(SAVE_FUSED_ROWS, y + count - row);
+		unsigned char* dst = out + (row - y) * rowBytes;
+		if (geometry.transform)
+			warpRows(*source, geometry.map, filter, geometry.width, row, rows, dst);
+		else
+			orientRows(geometry.orientation, source->data, channels, row, rows, dst);
+		if (adjustColour)
+			hsvEdit(geometry.width, rows, dst, hue, saturation, brightness, channels);
+	});
+}
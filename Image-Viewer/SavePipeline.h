@@ -0,0 +1,55 @@
+#pragma once
+#include "ImageData.h"
+#include "Orientation.h"
+#include "Warp.h"
+
+#define SAVE_BAND_ROWS 64
+
+struct Image;
+
+// The part of the view a transformed save cuts out, as a plain value : taken when the save is requested so later
+// panning doesn't change it, and free of any Image so the same cut out can be applied to other images.
+struct ViewTransform {
+	float zoom = 1.0f;
+	float angle = 0.0f;
+	float translationX = 0, translationY = 0;	// fractions of the oriented image size
+	int width = 0, height = 0;					// size of the cut out, 0 keeps the oriented image size
+	ResampleFilter filter = RESAMPLE_BICUBIC;
+};
+
+// Output rows oriented and colour adjusted together, few enough to still be in cache for the colour pass
+#define SAVE_FUSED_ROWS 8
+
+// Everything between the decoded source and a saved pixel, compiled into one mapping : the flips and rotation
+// of the Image and, with transform, the zoom, angle and translation of the view.
+struct SaveGeometry {
+	int width = 0, height = 0;	// output size
+	bool transform = false;
+	// Without transform every output pixel is one source pixel, laid out by the orientation
+	OrientationMap orientation;
+	// With it output pixel centers are resampled from the source through map
+	WarpMap map;
+};
+SaveGeometry compileSaveGeometry(const Image& image, int sourceWidth, int sourceHeight, bool transform, const ViewTransform& view);
+
+// The rows of an image as it is saved : flipped and rotated like the Image, colour adjusted and,
+// with transform, cut out by the ViewTransform. Only reads its arguments, any number can run at once. Rows are produced on request straight from the
+// decoded source in a single pass through the compiled SaveGeometry, so saving needs no intermediate copies.
+class SaveBandSource
+{
+public:
+	SaveBandSource(const Image& image, ImageDataPtr source, bool transform, const ViewTransform& view, bool adjustColour = true);
+
+	int getWidth() { return geometry.width; }
+	int getHeight() { return geometry.height; }
+	int getChannels() { return source->channels; }
+	// Rows [y, y + count) into out, width * channels bytes per row. Groups of SAVE_FUSED_ROWS run on the ThreadPool.
+	void readRows(int y, int count, unsigned char* out);
+private:
+	ImageDataPtr source;
+	SaveGeometry geometry;
+	ResampleFilter filter = RESAMPLE_BICUBIC;
+
+	bool adjustColour = false;
+	float hue = 0, saturation = 1, brightness = 1;
+};
@@ -0,0 +1,158 @@
+#include "SaveService.h"
+#include <filesystem>
+#include <algorithm>
+
+SaveService::SaveService(ImageCache* cache)
+{
+	this->cache = cache;
+	for (int i = 0; i < SAVE_WORKER_COUNT; i++)
+		workers.emplace_back(&SaveService::runWorker, this);
+}
+
+SaveService::~SaveService()
+{
+	jobsMutex.lock();
+	running = false;
+	jobsMutex.unlock();
+	jobsCondition.notify_all();
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+unsigned int SaveService::submit(const Image& image, const std::string& path, int type, bool transform, int quality, int compression, const ViewTransform& view)
+{
+	SaveJobPtr job = std::make_shared<SaveJob>();
+	job->image = image;
+	job->path = path.empty() ? image.imagePath : path;
+	job->type = type;
+	job->transform = transform;
+	job->quality = quality;
+	job->compression = compression;
+	job->view = view;
+
+	jobsMutex.lock();
+	job->id = nextId++;
+	jobs.push_back(job);
+	jobsMutex.unlock();
+	jobsCondition.notify_one();
+	return job->id;
+}
+
+void SaveService::cancel(unsigned int id)
+{
+	std::lock_guard g(jobsMutex);
+	for (SaveJobPtr& job : current) {
+		if (job->id == id) {
+			job->cancelled = true;
+			return;
+		}
+	}
+	auto it = std::find_if(jobs.begin(), jobs.end(), [id](const SaveJobPtr& job) { return job->id == id; });
+	if (it == jobs.end())
+		return;
+	(*it)->cancelled = true;
+	(*it)->state = SAVE_CANCELLED;
+	finished.push_back(*it);
+	jobs.erase(it);
+	if (finished.size() > SAVE_HISTORY_LENGTH)
+		finished.pop_front();
+}
+
+std::vector<SaveJobPtr> SaveService::getJobs()
+{
+	std::lock_guard g(jobsMutex);
+	std::vector<SaveJobPtr> list;
+	list.insert(list.end(), current.begin(), current.end());
+	list.insert(list.end(), jobs.begin(), jobs.end());
+	list.insert(list.end(), finished.rbegin(), finished.rend());
+	return list;
+}
+
+void SaveService::clearFinished()
+{
+	std::lock_guard g(jobsMutex);
+	finished.clear();
+}
+
+int SaveService::getActiveCount()
+{
+	std::lock_guard g(jobsMutex);
+	return jobs.size() + current.size();
+}
+
+void SaveService::runWorker()
+{
+	while (true) {
+		std::unique_lock lock(jobsMutex);
+		jobsCondition.wait(lock, [this] { return !jobs.empty() || !running; });
+		// Saves the user asked for are still written when the app closes
+		if (jobs.empty())
+			return;
+		SaveJobPtr job = jobs.front();
+		jobs.pop_front();
+		current.push_back(job);
+		lock.unlock();
+
+		bool saved = runSave(*job, cache);
+
+		lock.lock();
+		job->state = saved ? SAVE_DONE : job->cancelled ? SAVE_CANCELLED : SAVE_FAILED;
+		current.erase(std::find(current.begin(), current.end(), job));
+		finished.push_back(job);
+		if (finished.size() > SAVE_HISTORY_LENGTH)
+			finished.pop_front();
+	}
+}
+
+bool runSave(SaveJob& job, ImageCache* cache)
+{
+	job.state = SAVE_RUNNING;
+	// The loader most likely still holds the pixels it decoded for display
+	ImageDataPtr source = cache ? cache->findFullPixels(job.image.imagePath) : nullptr;
+	if (source)
+		cache->countReuse();
+	else
+		source = decodeImage(job.image.imagePath);
+	if (!source)
+		return false;
+
+	// Written next to the target and renamed at the end, a failed or cancelled save leaves the old file as it was.
+	// That also keeps the source intact while it is read when saving over it.
+	std::string partPath = job.path + ".part";
+	bool saved = false;
+	{
+		// Only a band of rows exists at a time besides the source, unless the format has to be encoded at once
+		SaveBandSource bands(job.image, source, job.transform, job.view);
+		std::unique_ptr<RowWriter> writer = createRowWriter(job.type, job.quality, job.compression);
+		if (writer->begin(partPath, bands.getWidth(), bands.getHeight(), bands.getChannels())) {
+			std::vector<unsigned char> band((size_t)bands.getWidth() * SAVE_BAND_ROWS * bands.getChannels());
+			saved = true;
+			for (int y = 0; y < bands.getHeight() && saved; y += SAVE_BAND_ROWS) {
+				if (job.cancelled) {
+					saved = false;
+					break;
+				}
+				int count = (std::min)(SAVE_BAND_ROWS, bands.getHeight() - y);
+				bands.readRows(y, count, band.data());
+				saved = writer->writeRows(band.data(), count);
+				job.progress = (float)(y + count) / bands.getHeight();
+			}
+			if (saved) {
+				job.state = SAVE_ENCODING;
+				saved = writer->finish();
+			}
+		}
+	}
+	// A mapped .bin stays open as long as something references its pixels, and the file can't be replaced while it is
+	source.reset();
+	if (cache)
+		cache->removePixels(job.path);
+	std::error_code error;
+	if (saved && !job.cancelled) {
+		std::filesystem::rename(partPath, job.path, error);
+		if (!error)
+			return true;
+	}
+	std::filesystem::remove(partPath, error);
+	return false;
+}
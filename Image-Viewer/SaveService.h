@@ -0,0 +1,68 @@
+#pragma once
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include "ImageManagment.h"
+
+// How many finished saves stay listed in the menu bar
+#define SAVE_HISTORY_LENGTH 8
+// Saves written at the same time, each one already spreads its rows and encoding over the ThreadPool
+#define SAVE_WORKER_COUNT 2
+
+enum SaveState {
+	SAVE_QUEUED = 0, SAVE_RUNNING, SAVE_ENCODING, SAVE_DONE, SAVE_FAILED, SAVE_CANCELLED
+};
+
+struct SaveJob {
+	unsigned int id = 0;
+	Image image;			// edit state when the save was requested
+	std::string path;
+	int type = PNG;
+	bool transform = false;
+	int quality = 80;
+	int compression = PNG_COMPRESSION_LEVEL;
+	ViewTransform view;
+	std::atomic<int> state = SAVE_QUEUED;
+	std::atomic<float> progress = 0.0f;	// rows done, the buffered formats encode after reaching 1
+	std::atomic<bool> cancelled = false;
+};
+typedef std::shared_ptr<SaveJob> SaveJobPtr;
+
+// Saves images on worker threads, so the render thread never waits for an encoder. A batch of saves runs
+// SAVE_WORKER_COUNT at a time. Jobs carry a copy of the Image and the view, edits made after submitting don't change what is written.
+class SaveService
+{
+public:
+	SaveService(ImageCache* cache);
+	// Finishes the saves that are still queued
+	~SaveService();
+
+	unsigned int submit(const Image& image, const std::string& path, int type, bool transform, int quality, int compression, const ViewTransform& view);
+	// A running save stops after its current band and removes the partial file
+	void cancel(unsigned int id);
+	// Queued and running saves, then the most recent finished ones
+	std::vector<SaveJobPtr> getJobs();
+	void clearFinished();
+	int getActiveCount();
+private:
+	void runWorker();
+
+	ImageCache* cache;
+	std::vector<std::thread> workers;
+	std::mutex jobsMutex;
+	std::condition_variable jobsCondition;
+	std::deque<SaveJobPtr> jobs;
+	std::deque<SaveJobPtr> finished;
+	std::vector<SaveJobPtr> current;
+	unsigned int nextId = 1;
+	bool running = true;
+};
+
+// Writes job.image to job.path, reporting progress in the job. Uses the cached pixels when there are any.
+// Everything it needs is in the job, so any number of saves can run at once.
+bool runSave(SaveJob& job, ImageCache* cache);
@@ -47,14 +47,19 @@ void Shader::loadShader(char* vertexSource, char* fragmentSource)
 }
 
 void Shader::drawImageWithModification(int texID, Image* image)
+{
+	drawTexturedQuad(texID, image, image->mod.positions, image->uv);
+}
+
+void Shader::drawTexturedQuad(int texID, Image* image, const ImVec2 quad[4], const ImVec2 quadUv[4])
 {
 	glUseProgram(shaderProgramID);
 
 	GLfloat positions[]={
-		image->mod.positions[0].x, image->mod.positions[0].y, 0,
-		image->mod.positions[1].x, image->mod.positions[1].y, 0,
-		image->mod.positions[2].x, image->mod.positions[2].y, 0,
-		image->mod.positions[3].x, image->mod.positions[3].y, 0
+		quad[0].x, quad[0].y, 0,
+		quad[1].x, quad[1].y, 0,
+		quad[2].x, quad[2].y, 0,
+		quad[3].x, quad[3].y, 0
 	};
 	GLfloat colors[] = {
 		image->mod.colors[0].x, image->mod.colors[0].y, image->mod.colors[0].z, image->mod.colors[0].w,
@@ -63,10 +68,10 @@ void Shader::drawImageWithModification(int texID, Image* image)
 		image->mod.colors[3].x, image->mod.colors[3].y, image->mod.colors[3].z, image->mod.colors[3].w
 	};
 	GLfloat uv[]{
-		image->uv[0].x, image->uv[0].y,
-		image->uv[1].x, image->uv[1].y,
-		image->uv[2].x, image->uv[2].y,
-		image->uv[3].x, image->uv[3].y
+		quadUv[0].x, quadUv[0].y,
+		quadUv[1].x, quadUv[1].y,
+		quadUv[2].x, quadUv[2].y,
+		quadUv[3].x, quadUv[3].y
 	};
 
 	glBindBuffer(GL_ARRAY_BUFFER, posData);
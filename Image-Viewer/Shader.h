@@ -19,6 +19,7 @@ public:
 	int shaderProgramID = -1;
 
 	void drawImageWithModification(int texID, Image* mod);
+	void drawTexturedQuad(int texID, Image* image, const ImVec2 quad[4], const ImVec2 quadUv[4]);
 
 	void activate();
 	void deactivate();
@@ -0,0 +1,96 @@
+#include "ThreadPool.h"
+
+// The pool the current thread works for, nullptr outside of every pool
+static thread_local ThreadPool* currentPool = nullptr;
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+{
+	if (threadCount == 0)
+		threadCount = std::thread::hardware_concurrency();
+	if (threadCount == 0)
+		threadCount = 1;
+	for (unsigned int i = 0; i < threadCount; i++) {
+		workers.emplace_back(&ThreadPool::runWorker, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	tasksMutex.lock();
+	running = false;
+	tasksMutex.unlock();
+	tasksCondition.notify_all();
+	for (auto& t : workers) {
+		if (t.joinable())
+			t.join();
+	}
+}
+
+ThreadPool* ThreadPool::getInstance()
+{
+	static ThreadPool pool;
+	return &pool;
+}
+
+std::future<void> ThreadPool::submit(std::function<void()> task)
+{
+	std::packaged_task<void()> packaged(task);
+	std::future<void> result = packaged.get_future();
+	tasksMutex.lock();
+	tasks.push_back(std::move(packaged));
+	tasksMutex.unlock();
+	tasksCondition.notify_one();
+	return result;
+}
+
+void ThreadPool::parallelFor(int count, std::function<void(int)> task)
+{
+	std::vector<std::future<void>> results;
+	for (int i = 0; i < count; i++) {
+		results.push_back(submit([&task, i] { task(i); }));
+	}
+	for (auto& result : results) {
+		wait(result);
+		result.get();
+	}
+}
+
+void ThreadPool::wait(std::future<void>& result)
+{
+	if (currentPool == this) {
+		// A task being waited for is either queued, then it runs here, or already running on another thread
+		while (result.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			if (!runQueuedTask())
+				break;
+		}
+	}
+	result.wait();
+}
+
+bool ThreadPool::runQueuedTask()
+{
+	std::unique_lock lock(tasksMutex);
+	if (tasks.empty())
+		return false;
+	std::packaged_task<void()> task = std::move(tasks.front());
+	tasks.pop_front();
+	lock.unlock();
+	task();
+	return true;
+}
+
+void ThreadPool::runWorker()
+{
+	currentPool = this;
+	while (true) {
+		std::unique_lock lock(tasksMutex);
+		tasksCondition.wait(lock, [this] { return !tasks.empty() || !running; });
+		// Tasks already submitted still run, whoever submitted them waits for their futures
+		if (tasks.empty())
+			return;
+		std::packaged_task<void()> task = std::move(tasks.front());
+		tasks.pop_front();
+		lock.unlock();
+		task();
+	}
+}
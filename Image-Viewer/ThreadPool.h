@@ -0,0 +1,38 @@
+#pragma once
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <vector>
+#include <functional>
+#include <future>
+
+// Runs independent pieces of one bigger task (encoding, resampling) on a fixed set of threads.
+// A task that waits for other tasks has to do it with wait or parallelFor, which run queued tasks on a pool thread
+// instead of blocking it, otherwise the pool can end up with every thread waiting on tasks nobody runs.
+class ThreadPool
+{
+public:
+	ThreadPool(unsigned int threadCount = 0);
+	~ThreadPool();
+
+	// Shared by the encoders and image processing, one thread per core
+	static ThreadPool* getInstance();
+
+	std::future<void> submit(std::function<void()> task);
+	// task(i) for every i in [0, count), returns when all of them are done. Can be called from a pool task.
+	void parallelFor(int count, std::function<void(int)> task);
+	// Returns when the task of result is done, on a pool thread the queued tasks are run meanwhile
+	void wait(std::future<void>& result);
+	unsigned int getThreadCount() { return workers.size(); }
+private:
+	void runWorker();
+	// Runs the first queued task if there is one
+	bool runQueuedTask();
+
+	std::vector<std::thread> workers;
+	std::deque<std::packaged_task<void()>> tasks;
+	std::mutex tasksMutex;
+	std::condition_variable tasksCondition;
+	bool running = true;
+};
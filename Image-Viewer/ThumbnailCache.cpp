@@ -0,0 +1,454 @@
+#include "ThumbnailCache.h"
+#include "ImageManagment.h"
+#include "TileSource.h"
+#include <glad/glad.h>
+#include <filesystem>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+namespace fs = std::filesystem;
+
+static const char cacheMagic[4] = { 'I', 'V', 'T', 'C' };
+static const unsigned int cacheVersion = 1;
+static const long long cacheHeaderBytes = 8;
+
+template<typename T>
+static bool readValue(std::fstream& file, T& value)
+{
+	return (bool)file.read(reinterpret_cast<char*>(&value), sizeof(T));
+}
+
+template<typename T>
+static void writeValue(std::fstream& file, T value)
+{
+	file.write(reinterpret_cast<char*>(&value), sizeof(T));
+}
+
+static void appendBytes(void* context, void* data, int size)
+{
+	std::vector<unsigned char>* bytes = (std::vector<unsigned char>*)context;
+	bytes->insert(bytes->end(), (unsigned char*)data, (unsigned char*)data + size);
+}
+
+ThumbnailCache::ThumbnailCache(std::string cacheFile)
+{
+	this->cacheFile = cacheFile.empty() ? defaultCacheFile() : cacheFile;
+	worker = std::thread(&ThumbnailCache::runWorker, this);
+}
+
+ThumbnailCache::~ThumbnailCache()
+{
+	requestsMutex.lock();
+	running = false;
+	requestsMutex.unlock();
+	requestsCondition.notify_all();
+	if (worker.joinable())
+		worker.join();
+	for (AtlasPage& page : pages)
+		glDeleteTextures(1, &page.texId);
+}
+
+std::string ThumbnailCache::defaultCacheFile()
+{
+	const char* localAppData = std::getenv("LOCALAPPDATA");
+	fs::path dir = localAppData != nullptr ? fs::path(localAppData) : fs::temp_directory_path();
+	dir /= "Image-Viewer";
+	std::error_code error;
+	fs::create_directories(dir, error);
+	return (dir / "thumbnails.cache").string();
+}
+
+bool ThumbnailCache::get(const std::string& imagePath, Thumbnail& thumbnail)
+{
+	auto it = thumbnails.find(imagePath);
+	if (it != thumbnails.end()) {
+		it->second.lastUsed = frame;
+		thumbnail = it->second;
+		return true;
+	}
+	std::lock_guard g(requestsMutex);
+	if (pending.contains(imagePath))
+		return false;
+	pending.insert(imagePath);
+	requests.push_back(imagePath);
+	// The strip moved on, the oldest requests are not visible anymore
+	while (requests.size() > THUMBNAIL_QUEUE_LENGTH) {
+		pending.erase(requests.front());
+		requests.pop_front();
+	}
+	requestsCondition.notify_one();
+	return false;
+}
+
+bool ThumbnailCache::allocateSlot(Thumbnail& thumbnail)
+{
+	for (int page = 0; page < pages.size(); page++) {
+		for (int slot = 0; slot < pages[page].slots.size(); slot++) {
+			if (pages[page].slots[slot].empty()) {
+				thumbnail.page = page;
+				thumbnail.slot = slot;
+				return true;
+			}
+		}
+	}
+	if (pages.size() < THUMBNAIL_ATLAS_PAGES) {
+		AtlasPage page;
+		glGenTextures(1, &page.texId);
+		glBindTexture(GL_TEXTURE_2D, page.texId);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		// Below this level a texel would cover more than one slot
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (int)std::log2(THUMBNAIL_SIZE));
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, THUMBNAIL_ATLAS_SIZE, THUMBNAIL_ATLAS_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		int perRow = THUMBNAIL_ATLAS_SIZE / THUMBNAIL_SIZE;
+		page.slots.resize(perRow * perRow);
+		pages.push_back(page);
+		thumbnail.page = pages.size() - 1;
+		thumbnail.slot = 0;
+		return true;
+	}
+	// Recycle the least recently drawn slot, but never one that was on screen last frame
+	auto oldest = thumbnails.end();
+	for (auto it = thumbnails.begin(); it != thumbnails.end(); it++) {
+		if (it->second.lastUsed < frame && (oldest == thumbnails.end() || it->second.lastUsed < oldest->second.lastUsed))
+			oldest = it;
+	}
+	if (oldest == thumbnails.end())
+		return false;
+	thumbnail.page = oldest->second.page;
+	thumbnail.slot = oldest->second.slot;
+	pages[thumbnail.page].slots[thumbnail.slot].clear();
+	thumbnails.erase(oldest);
+	return true;
+}
+
+void ThumbnailCache::process()
+{
+	std::vector<std::pair<std::string, ImageDataPtr>> ready;
+	requestsMutex.lock();
+	int count = std::min((int)finished.size(), THUMBNAIL_UPLOADS_PER_FRAME);
+	ready.assign(finished.begin(), finished.begin() + count);
+	finished.erase(finished.begin(), finished.begin() + count);
+	requestsMutex.unlock();
+
+	// The thumbnail is padded to the whole slot by repeating its last row and column,
+	// so the smaller mip levels don't blend in the neighbouring slots
+	std::vector<unsigned char> slotPixels((size_t)THUMBNAIL_SIZE * THUMBNAIL_SIZE * 4);
+	int perRow = THUMBNAIL_ATLAS_SIZE / THUMBNAIL_SIZE;
+	int uploaded = 0;
+	for (auto& [path, image] : ready) {
+		Thumbnail thumbnail;
+		if (!allocateSlot(thumbnail))
+			break;
+		uploaded++;
+		thumbnail.w = std::min(image->width, THUMBNAIL_SIZE);
+		thumbnail.h = std::min(image->height, THUMBNAIL_SIZE);
+		thumbnail.lastUsed = frame;
+		int channels = image->channels;
+		for (int y = 0; y < THUMBNAIL_SIZE; y++) {
+			const unsigned char* row = image->data + (size_t)std::min(y, thumbnail.h - 1) * image->width * channels;
+			unsigned char* dst = slotPixels.data() + (size_t)y * THUMBNAIL_SIZE * 4;
+			for (int x = 0; x < THUMBNAIL_SIZE; x++) {
+				const unsigned char* src = row + std::min(x, thumbnail.w - 1) * channels;
+				dst[0] = src[0];
+				dst[1] = channels >= 3 ? src[1] : src[0];
+				dst[2] = channels >= 3 ? src[2] : src[0];
+				dst[3] = channels == 4 ? src[3] : channels == 2 ? src[1] : 255;
+				dst += 4;
+			}
+		}
+		AtlasPage& page = pages[thumbnail.page];
+		int slotX = thumbnail.slot % perRow * THUMBNAIL_SIZE;
+		int slotY = thumbnail.slot / perRow * THUMBNAIL_SIZE;
+		glBindTexture(GL_TEXTURE_2D, page.texId);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, slotX, slotY, THUMBNAIL_SIZE, THUMBNAIL_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, slotPixels.data());
+		page.dirty = true;
+		page.slots[thumbnail.slot] = path;
+
+		thumbnail.texId = page.texId;
+		thumbnail.uv0 = { (float)slotX / THUMBNAIL_ATLAS_SIZE, (float)slotY / THUMBNAIL_ATLAS_SIZE };
+		thumbnail.uv1 = { (float)(slotX + thumbnail.w) / THUMBNAIL_ATLAS_SIZE, (float)(slotY + thumbnail.h) / THUMBNAIL_ATLAS_SIZE };
+		thumbnails[path] = thumbnail;
+	}
+	for (AtlasPage& page : pages) {
+		if (page.dirty) {
+			glBindTexture(GL_TEXTURE_2D, page.texId);
+			glGenerateMipmap(GL_TEXTURE_2D);
+			page.dirty = false;
+		}
+	}
+
+	requestsMutex.lock();
+	for (int i = 0; i < uploaded; i++)
+		pending.erase(ready[i].first);
+	// Every slot is on screen, try again next frame
+	finished.insert(finished.begin(), ready.begin() + uploaded, ready.end());
+	requestsMutex.unlock();
+	frame++;
+}
+
+int ThumbnailCache::getPendingCount()
+{
+	std::lock_guard g(requestsMutex);
+	return pending.size();
+}
+
+void ThumbnailCache::runWorker()
+{
+	openFile();
+	while (true) {
+		std::unique_lock lock(requestsMutex);
+		requestsCondition.wait(lock, [this] { return !requests.empty() || !running; });
+		if (!running)
+			break;
+		// The most recent request is the one currently on screen
+		std::string imagePath = requests.back();
+		requests.pop_back();
+		lock.unlock();
+
+		ImageDataPtr thumbnail = loadThumbnail(imagePath);
+
+		lock.lock();
+		// Stays pending until it is uploaded, so it isn't requested again meanwhile
+		if (thumbnail)
+			finished.push_back({ imagePath, thumbnail });
+		else
+			pending.erase(imagePath);
+	}
+	file.close();
+}
+
+void ThumbnailCache::openFile()
+{
+	file.open(cacheFile, std::ios::in | std::ios::out | std::ios::binary);
+	if (!file.is_open()) {
+		file.open(cacheFile, std::ios::out | std::ios::binary | std::ios::trunc);
+		file.write(cacheMagic, 4);
+		writeValue(file, cacheVersion);
+		file.close();
+		file.open(cacheFile, std::ios::in | std::ios::out | std::ios::binary);
+		if (!file.is_open())
+			return;
+	}
+
+	char magic[4] = {};
+	unsigned int version = 0;
+	file.read(magic, 4);
+	readValue(file, version);
+	if (!file || memcmp(magic, cacheMagic, 4) != 0 || version != cacheVersion) {
+		file.close();
+		file.open(cacheFile, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+		file.write(cacheMagic, 4);
+		writeValue(file, cacheVersion);
+		fileEnd = file.tellp();
+		return;
+	}
+
+	// Index the records, a record cut off by a crash ends the file
+	fileEnd = file.tellg();
+	liveBytes = 0;
+	while (true) {
+		unsigned short pathLength = 0;
+		if (!readValue(file, pathLength))
+			break;
+		std::string path(pathLength, '\0');
+		Record record;
+		record.start = fileEnd;
+		unsigned short width = 0, height = 0;
+		unsigned char channels = 0;
+		unsigned int dataLength = 0;
+		file.read(path.data(), pathLength);
+		readValue(file, record.modified);
+		readValue(file, record.size);
+		record.offset = file.tellg();
+		readValue(file, width);
+		readValue(file, height);
+		readValue(file, channels);
+		readValue(file, dataLength);
+		if (!file)
+			break;
+		file.seekg(dataLength, std::ios::cur);
+		if (!file || (long long)file.tellg() > (long long)fs::file_size(cacheFile))
+			break;
+		fileEnd = file.tellg();
+		record.length = fileEnd - record.start;
+		auto previous = records.find(path);
+		if (previous != records.end())
+			liveBytes -= previous->second.length;
+		records[path] = record;
+		liveBytes += record.length;
+	}
+	file.clear();
+	file.close();
+	std::error_code error;
+	if ((long long)fs::file_size(cacheFile, error) > fileEnd)
+		fs::resize_file(cacheFile, fileEnd, error);
+	file.open(cacheFile, std::ios::in | std::ios::out | std::ios::binary);
+
+	// Images deleted or moved since, their records are dead now
+	for (auto it = records.begin(); it != records.end();) {
+		if (!fs::exists(it->first, error)) {
+			liveBytes -= it->second.length;
+			it = records.erase(it);
+		}
+		else {
+			it++;
+		}
+	}
+	compactIfNeeded();
+}
+
+void ThumbnailCache::compactIfNeeded()
+{
+	long long deadBytes = fileEnd - cacheHeaderBytes - liveBytes;
+	if (deadBytes > THUMBNAIL_CACHE_MAX_DEAD_BYTES || fileEnd > THUMBNAIL_CACHE_MAX_BYTES)
+		compact(fileEnd > THUMBNAIL_CACHE_MAX_BYTES ? THUMBNAIL_CACHE_MAX_BYTES / 4 * 3 : THUMBNAIL_CACHE_MAX_BYTES);
+}
+
+void ThumbnailCache::compact(long long maxBytes)
+{
+	if (!file.is_open())
+		return;
+	// In file order, which is the order they were generated in
+	std::vector<std::pair<std::string, Record*>> live;
+	for (auto& [path, record] : records)
+		live.push_back({ path, &record });
+	std::sort(live.begin(), live.end(), [](const auto& a, const auto& b) { return a.second->start < b.second->start; });
+	size_t first = 0;
+	long long keptBytes = liveBytes;
+	while (first < live.size() && cacheHeaderBytes + keptBytes > maxBytes)
+		keptBytes -= live[first++].second->length;
+
+	std::string compactedFile = cacheFile + ".compact";
+	std::fstream compacted(compactedFile, std::ios::out | std::ios::binary | std::ios::trunc);
+	compacted.write(cacheMagic, 4);
+	writeValue(compacted, cacheVersion);
+	std::vector<char> bytes;
+	std::unordered_map<std::string, Record> kept;
+	for (size_t i = first; i < live.size() && compacted; i++) {
+		Record record = *live[i].second;
+		bytes.resize(record.length);
+		file.seekg(record.start);
+		if (!file.read(bytes.data(), record.length)) {
+			file.clear();
+			continue;
+		}
+		long long start = compacted.tellp();
+		compacted.write(bytes.data(), record.length);
+		record.offset += start - record.start;
+		record.start = start;
+		kept[live[i].first] = record;
+	}
+	compacted.flush();
+	bool written = (bool)compacted;
+	compacted.close();
+	std::error_code error;
+	if (!written) {
+		fs::remove(compactedFile, error);
+		return;
+	}
+
+	file.close();
+	fs::rename(compactedFile, cacheFile, error);
+	file.open(cacheFile, std::ios::in | std::ios::out | std::ios::binary);
+	if (error) {
+		// The old file is still in place and its index still valid
+		fs::remove(compactedFile, error);
+		return;
+	}
+	records.swap(kept);
+	liveBytes = 0;
+	for (auto& [path, record] : records)
+		liveBytes += record.length;
+	fileEnd = cacheHeaderBytes + liveBytes;
+}
+
+ImageDataPtr ThumbnailCache::readRecord(const Record& record)
+{
+	unsigned short width = 0, height = 0;
+	unsigned char channels = 0;
+	unsigned int dataLength = 0;
+	file.seekg(record.offset);
+	readValue(file, width);
+	readValue(file, height);
+	readValue(file, channels);
+	readValue(file, dataLength);
+	std::vector<unsigned char> bytes(dataLength);
+	file.read((char*)bytes.data(), dataLength);
+	if (!file) {
+		file.clear();
+		return nullptr;
+	}
+	int w, h, c;
+	unsigned char* data = stbi_load_from_memory(bytes.data(), dataLength, &w, &h, &c, channels);
+	if (data == nullptr)
+		return nullptr;
+	return std::make_shared<ImageData>(data, w, h, channels, stbi_image_free);
+}
+
+void ThumbnailCache::appendRecord(const std::string& imagePath, long long modified, unsigned long long size, ImageData* thumbnail)
+{
+	std::vector<unsigned char> bytes;
+	if (thumbnail->channels == 4)
+		stbi_write_png_to_func(appendBytes, &bytes, thumbnail->width, thumbnail->height, 4, thumbnail->data, thumbnail->width * 4);
+	else
+		stbi_write_jpg_to_func(appendBytes, &bytes, thumbnail->width, thumbnail->height, thumbnail->channels, thumbnail->data, 85);
+	if (bytes.empty() || !file.is_open())
+		return;
+
+	long long start = fileEnd;
+	file.seekp(fileEnd);
+	writeValue(file, (unsigned short)imagePath.size());
+	file.write(imagePath.data(), imagePath.size());
+	writeValue(file, modified);
+	writeValue(file, size);
+	Record record = { (long long)file.tellp(), modified, size, start };
+	writeValue(file, (unsigned short)thumbnail->width);
+	writeValue(file, (unsigned short)thumbnail->height);
+	writeValue(file, (unsigned char)thumbnail->channels);
+	writeValue(file, (unsigned int)bytes.size());
+	file.write((char*)bytes.data(), bytes.size());
+	file.flush();
+	if (!file) {
+		file.clear();
+		return;
+	}
+	fileEnd = file.tellp();
+	record.length = fileEnd - start;
+	auto previous = records.find(imagePath);
+	if (previous != records.end())
+		liveBytes -= previous->second.length;
+	records[imagePath] = record;
+	liveBytes += record.length;
+	compactIfNeeded();
+}
+
+ImageDataPtr ThumbnailCache::loadThumbnail(const std::string& imagePath)
+{
+	std::error_code error;
+	long long modified = fs::last_write_time(imagePath, error).time_since_epoch().count();
+	unsigned long long size = fs::file_size(imagePath, error);
+	if (error)
+		return nullptr;
+
+	auto it = records.find(imagePath);
+	if (it != records.end() && it->second.modified == modified && it->second.size == size) {
+		ImageDataPtr thumbnail = readRecord(it->second);
+		if (thumbnail) {
+			diskHits++;
+			return thumbnail;
+		}
+	}
+
+	ImageDataPtr image = decodeImage(imagePath, THUMBNAIL_SIZE, THUMBNAIL_SIZE);
+	if (!image)
+		return nullptr;
+	ImageDataPtr thumbnail = downscaleToFit(image.get(), THUMBNAIL_SIZE);
+	appendRecord(imagePath, modified, size, thumbnail.get());
+	generated++;
+	return thumbnail;
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <fstream>
+#include <imgui.h>
+#include "ImageData.h"
+
+#define THUMBNAIL_SIZE 256
+#define THUMBNAIL_QUEUE_LENGTH 64
+#define THUMBNAIL_UPLOADS_PER_FRAME 16
+#define THUMBNAIL_ATLAS_SIZE 2048
+#define THUMBNAIL_ATLAS_PAGES 4
+// The cache file is compacted once replaced and removed records take up this much of it
+#define THUMBNAIL_CACHE_MAX_DEAD_BYTES (16 * 1024 * 1024)
+// Past this size compaction drops the oldest records until the file is down to 3/4 of it
+#define THUMBNAIL_CACHE_MAX_BYTES (256 * 1024 * 1024)
+
+// texId is the atlas page, uv0 and uv1 the corners of the thumbnail in it
+struct Thumbnail {
+	unsigned int texId = -1;
+	ImVec2 uv0, uv1;
+	int w = 0, h = 0;
+	int page = -1, slot = -1;
+	unsigned long long lastUsed = 0;
+};
+
+// Small previews of the images for the strip, generated on a background thread.
+// They are kept in a single packed file keyed by path, modification time and size, so every
+// image is only decoded in full once. Records are appended, a newer record for a path replaces the older one.
+// The file is rewritten with only the live records when the dead ones pile up, records of images that no longer
+// exist are dropped when it is opened.
+// Uploaded thumbnails share a few atlas pages with one fixed size slot each, so the whole strip is drawn from the
+// same texture. The least recently drawn slot is recycled when a page is full.
+//
+// File : "IVTC" version(4 bytes), then records of
+//	path length(2 bytes), path, modification time(8 bytes), file size(8 bytes),
+//	width(2 bytes), height(2 bytes), channels(1 byte), data length(4 bytes), data (jpg or png for 4 channels)
+class ThumbnailCache
+{
+public:
+	ThumbnailCache(std::string cacheFile = std::string());
+	// With the GL context current
+	~ThumbnailCache();
+
+	// Only on the render thread, returns false and queues the thumbnail when it isn't uploaded yet
+	bool get(const std::string& imagePath, Thumbnail& thumbnail);
+	// Only on the render thread, uploads the finished thumbnails
+	void process();
+
+	int getPendingCount();
+	int getSlotCount() { return thumbnails.size(); }
+	int getPageCount() { return pages.size(); }
+	unsigned int getDiskHits() { return diskHits; }
+	unsigned int getGenerated() { return generated; }
+	static std::string defaultCacheFile();
+private:
+	struct Record {
+		long long offset = 0;		// of the width field
+		long long modified = 0;
+		unsigned long long size = 0;
+		long long start = 0;		// of the whole record, from the path length on
+		long long length = 0;
+	};
+	struct AtlasPage {
+		unsigned int texId = -1;
+		std::vector<std::string> slots;
+		bool dirty = false;
+	};
+	void runWorker();
+	bool allocateSlot(Thumbnail& thumbnail);
+	void openFile();
+	ImageDataPtr readRecord(const Record& record);
+	void appendRecord(const std::string& imagePath, long long modified, unsigned long long size, ImageData* thumbnail);
+	// Compacts the file when it has too many dead bytes or is over its size
+	void compactIfNeeded();
+	// Rewrites the file with only the live records, the oldest dropped until it is at most maxBytes
+	void compact(long long maxBytes);
+	ImageDataPtr loadThumbnail(const std::string& imagePath);
+
+	std::string cacheFile;
+	std::fstream file;
+	long long fileEnd = 0;
+	long long liveBytes = 0;	// of the records still in records, the rest up to fileEnd is dead
+	std::unordered_map<std::string, Record> records;
+
+	std::thread worker;
+	std::mutex requestsMutex;
+	std::condition_variable requestsCondition;
+	std::deque<std::string> requests;
+	std::unordered_set<std::string> pending;
+	std::vector<std::pair<std::string, ImageDataPtr>> finished;
+	bool running = true;
+
+	std::unordered_map<std::string, Thumbnail> thumbnails;
+	std::vector<AtlasPage> pages;
+	unsigned long long frame = 0;
+	unsigned int diskHits = 0;
+	unsigned int generated = 0;
+};
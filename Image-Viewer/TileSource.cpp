@@ -0,0 +1,102 @@
+#include "TileSource.h"
+#include <algorithm>
+#include <cstring>
+
+int TileSource::levelCountFor(int width, int height)
+{
+	int levels = 1;
+	while (width > TILE_SIZE || height > TILE_SIZE) {
+		width = (width + 1) / 2;
+		height = (height + 1) / 2;
+		levels++;
+	}
+	return levels;
+}
+
+PyramidTileSource::PyramidTileSource(ImageDataPtr image)
+{
+	levels.push_back(image);
+	int count = levelCountFor(image->width, image->height);
+	for (int i = 1; i < count; i++) {
+		levels.push_back(downscaleHalf(levels.back().get()));
+	}
+}
+
+ImageDataPtr PyramidTileSource::getTile(int level, int column, int row)
+{
+	ImageData* image = levels[level].get();
+	int x = column * TILE_SIZE;
+	int y = row * TILE_SIZE;
+	return copyRegion(image, x, y, std::min(TILE_SIZE, image->width - x), std::min(TILE_SIZE, image->height - y));
+}
+
+size_t PyramidTileSource::getResidentBytes()
+{
+	size_t bytes = 0;
+	for (ImageDataPtr& level : levels)
+		bytes += level->size();
+	return bytes;
+}
+
+// 2x2 box filter, the last row / column is repeated for odd sizes
+ImageDataPtr downscaleHalf(ImageData* image)
+{
+	int width = (image->width + 1) / 2;
+	int height = (image->height + 1) / 2;
+	int channels = image->channels;
+	unsigned char* data = new unsigned char[(size_t)width * height * channels];
+	size_t srcStride = (size_t)image->width * channels;
+	for (int y = 0; y < height; y++) {
+		const unsigned char* row0 = image->data + std::min(y * 2, image->height - 1) * srcStride;
+		const unsigned char* row1 = image->data + std::min(y * 2 + 1, image->height - 1) * srcStride;
+		unsigned char* dst = data + (size_t)y * width * channels;
+		for (int x = 0; x < width; x++) {
+			int x0 = x * 2 * channels;
+			int x1 = std::min(x * 2 + 1, image->width - 1) * channels;
+			for (int c = 0; c < channels; c++) {
+				dst[x * channels + c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4;
+			}
+		}
+	}
+	return std::make_shared<ImageData>(data, width, height, channels, [](unsigned char* d) { delete[] d; });
+}
+
+ImageDataPtr downscaleToFit(ImageData* image, int maxSize)
+{
+	double scale = std::min(1.0, std::min((double)maxSize / image->width, (double)maxSize / image->height));
+	int width = std::max(1, (int)(image->width * scale));
+	int height = std::max(1, (int)(image->height * scale));
+	int channels = image->channels;
+	unsigned char* data = new unsigned char[(size_t)width * height * channels];
+	std::vector<unsigned int> sums(channels);
+	for (int y = 0; y < height; y++) {
+		int sy0 = (int)((long long)y * image->height / height);
+		int sy1 = std::max(sy0 + 1, (int)((long long)(y + 1) * image->height / height));
+		for (int x = 0; x < width; x++) {
+			int sx0 = (int)((long long)x * image->width / width);
+			int sx1 = std::max(sx0 + 1, (int)((long long)(x + 1) * image->width / width));
+			std::fill(sums.begin(), sums.end(), 0);
+			for (int sy = sy0; sy < sy1; sy++) {
+				const unsigned char* src = image->data + ((size_t)sy * image->width + sx0) * channels;
+				for (int sx = sx0; sx < sx1; sx++) {
+					for (int c = 0; c < channels; c++)
+						sums[c] += *src++;
+				}
+			}
+			unsigned int count = (sy1 - sy0) * (sx1 - sx0);
+			for (int c = 0; c < channels; c++)
+				data[((size_t)y * width + x) * channels + c] = (sums[c] + count / 2) / count;
+		}
+	}
+	return std::make_shared<ImageData>(data, width, height, channels, [](unsigned char* d) { delete[] d; });
+}
+
+ImageDataPtr copyRegion(ImageData* image, int x, int y, int width, int height)
+{
+	int channels = image->channels;
+	unsigned char* data = new unsigned char[(size_t)width * height * channels];
+	for (int row = 0; row < height; row++) {
+		memcpy(data + (size_t)row * width * channels, image->data + ((size_t)(y + row) * image->width + x) * channels, (size_t)width * channels);
+	}
+	return std::make_shared<ImageData>(data, width, height, channels, [](unsigned char* d) { delete[] d; });
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include "ImageData.h"
+
+#define TILE_SIZE 1024
+
+// Supplies the tiles of a multi-resolution image pyramid.
+// Level 0 is the full resolution, every next level is half the size, the last level fits in a single tile.
+class TileSource
+{
+public:
+	virtual ~TileSource() {}
+
+	virtual int getWidth() = 0;
+	virtual int getHeight() = 0;
+	virtual int getChannels() = 0;
+	virtual int getLevelCount() = 0;
+	// Pixels of the tile at column, row of the level, TILE_SIZE or smaller at the right and bottom edge
+	virtual ImageDataPtr getTile(int level, int column, int row) = 0;
+	// Memory held by the source itself, not counting tiles handed out
+	virtual size_t getResidentBytes() = 0;
+	// The whole level in one piece
+	virtual ImageDataPtr getLevel(int level) = 0;
+
+	int getLevelWidth(int level) { return std::max(1, (getWidth() + (1 << level) - 1) >> level); }
+	int getLevelHeight(int level) { return std::max(1, (getHeight() + (1 << level) - 1) >> level); }
+	static int levelCountFor(int width, int height);
+};
+
+// Pyramid built in memory from a decoded image
+class PyramidTileSource : public TileSource
+{
+public:
+	PyramidTileSource(ImageDataPtr image);
+
+	int getWidth() override { return levels[0]->width; }
+	int getHeight() override { return levels[0]->height; }
+	int getChannels() override { return levels[0]->channels; }
+	int getLevelCount() override { return levels.size(); }
+	ImageDataPtr getTile(int level, int column, int row) override;
+	size_t getResidentBytes() override;
+	ImageDataPtr getLevel(int level) override { return levels[level]; }
+private:
+	std::vector<ImageDataPtr> levels;
+};
+
+ImageDataPtr downscaleHalf(ImageData* image);
+// Area average down to fit in maxSize x maxSize, keeps the aspect ratio
+ImageDataPtr downscaleToFit(ImageData* image, int maxSize);
+ImageDataPtr copyRegion(ImageData* image, int x, int y, int width, int height);
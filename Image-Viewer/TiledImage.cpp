@@ -0,0 +1,155 @@
+#include "TiledImage.h"
+#include "Shader.h"
+#include <chrono>
+#include <cmath>
+
+int TiledImage::maxTextureSize = TILED_IMAGE_SIZE;
+
+static double now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+TiledImage::TiledImage(std::shared_ptr<TileSource> source)
+{
+	this->source = source;
+	for (int i = 0; i < source->getLevelCount(); i++) {
+		Level level;
+		level.width = source->getLevelWidth(i);
+		level.height = source->getLevelHeight(i);
+		level.columns = (level.width + TILE_SIZE - 1) / TILE_SIZE;
+		level.rows = (level.height + TILE_SIZE - 1) / TILE_SIZE;
+		level.tiles.resize(level.columns * level.rows);
+		levels.push_back(level);
+	}
+}
+
+bool TiledImage::needsTiling(int width, int height)
+{
+	int limit = std::min(maxTextureSize, TILED_IMAGE_SIZE);
+	return width > limit || height > limit;
+}
+
+ImageDataPtr TiledImage::getPreview()
+{
+	return source->getTile(levels.size() - 1, 0, 0);
+}
+
+void TiledImage::draw(Shader* shader, Image* image, float scale, double budget)
+{
+	std::lock_guard g(tilesMutex);
+	if (released || levels.size() < 2)
+		return;
+	double start = now();
+	frame++;
+
+	int level = scale > 0 ? (int)floor(log2(1.0 / scale)) : 0;
+	level = std::max(0, std::min(level, (int)levels.size() - 2));
+	Level& l = levels[level];
+
+	// Image uv (0..1) to screen, every corner of the quad knows which uv corner it shows
+	auto toScreen = [image](float u, float v) {
+		ImVec2 p = { 0, 0 };
+		for (int i = 0; i < 4; i++) {
+			float w = (image->uv[i].x > 0.5f ? u : 1 - u) * (image->uv[i].y > 0.5f ? v : 1 - v);
+			p.x += image->mod.positions[i].x * w;
+			p.y += image->mod.positions[i].y * w;
+		}
+		return p;
+	};
+
+	for (int row = 0; row < l.rows; row++) {
+		for (int column = 0; column < l.columns; column++) {
+			float u0 = (float)(column * TILE_SIZE) / l.width;
+			float v0 = (float)(row * TILE_SIZE) / l.height;
+			float u1 = (float)std::min((column + 1) * TILE_SIZE, l.width) / l.width;
+			float v1 = (float)std::min((row + 1) * TILE_SIZE, l.height) / l.height;
+			ImVec2 positions[4] = { toScreen(u0, v0), toScreen(u1, v0), toScreen(u1, v1), toScreen(u0, v1) };
+
+			float minX = positions[0].x, maxX = positions[0].x, minY = positions[0].y, maxY = positions[0].y;
+			for (int i = 1; i < 4; i++) {
+				minX = std::min(minX, positions[i].x);
+				maxX = std::max(maxX, positions[i].x);
+				minY = std::min(minY, positions[i].y);
+				maxY = std::max(maxY, positions[i].y);
+			}
+			if (maxX < -1.0f || minX > 1.0f || maxY < -1.0f || minY > 1.0f)
+				continue;
+
+			Tile& tile = l.tiles[row * l.columns + column];
+			if (tile.texId == -1) {
+				// Out of time for this frame, the preview below shows through until the next one
+				if (now() - start >= budget)
+					continue;
+				tile.texId = uploadTile(level, column, row);
+				if (tile.texId == -1)
+					continue;
+			}
+			tile.lastUsed = frame;
+			ImVec2 uv[4] = { ImVec2(0, 0), ImVec2(1, 0), ImVec2(1, 1), ImVec2(0, 1) };
+			shader->drawTexturedQuad(tile.texId, image, positions, uv);
+		}
+	}
+	evictTiles();
+}
+
+unsigned int TiledImage::uploadTile(int level, int column, int row)
+{
+	ImageDataPtr tile = source->getTile(level, column, row);
+	if (!tile)
+		return -1;
+	unsigned int texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tile->width, tile->height, 0, tile->channels == 3 ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, tile->data);
+	return texture;
+}
+
+void TiledImage::evictTiles()
+{
+	for (Level& level : levels) {
+		for (Tile& tile : level.tiles) {
+			if (tile.texId != -1 && frame - tile.lastUsed > TILE_EVICT_FRAMES) {
+				glDeleteTextures(1, &tile.texId);
+				tile.texId = -1;
+			}
+		}
+	}
+}
+
+void TiledImage::release(std::function<void(unsigned int)> deleteTexture)
+{
+	std::lock_guard g(tilesMutex);
+	released = true;
+	for (Level& level : levels) {
+		for (Tile& tile : level.tiles) {
+			if (tile.texId != -1)
+				deleteTexture(tile.texId);
+			tile.texId = -1;
+		}
+	}
+}
+
+void TiledImage::restore()
+{
+	std::lock_guard g(tilesMutex);
+	released = false;
+}
+
+int TiledImage::getResidentTiles()
+{
+	std::lock_guard g(tilesMutex);
+	int count = 0;
+	for (Level& level : levels) {
+		for (Tile& tile : level.tiles) {
+			if (tile.texId != -1)
+				count++;
+		}
+	}
+	return count;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <functional>
+#include "TileSource.h"
+
+#define TILED_IMAGE_SIZE 8192
+#define TILE_EVICT_FRAMES 30
+
+class Shader;
+struct Image;
+
+// Image too large for a single texture, drawn from the tiles of a TileSource.
+// Only the tiles that intersect the view at the level matching the zoom are uploaded,
+// tiles that were not drawn for TILE_EVICT_FRAMES frames are deleted again.
+class TiledImage
+{
+public:
+	TiledImage(std::shared_ptr<TileSource> source);
+	~TiledImage() {}
+
+	static bool needsTiling(int width, int height);
+	static void setMaxTextureSize(int size) { maxTextureSize = size; }
+
+	int getWidth() { return source->getWidth(); }
+	int getHeight() { return source->getHeight(); }
+	int getChannels() { return source->getChannels(); }
+	std::shared_ptr<TileSource> getSource() { return source; }
+	// The coarsest level in one piece, used as the image texture while the tiles stream in
+	ImageDataPtr getPreview();
+
+	// Only on the render thread, scale is the number of screen pixels per image pixel
+	void draw(Shader* shader, Image* image, float scale, double budget);
+	// The textures are handed to deleteTexture, nothing is drawn afterwards until restore
+	void release(std::function<void(unsigned int)> deleteTexture);
+	void restore();
+	int getResidentTiles();
+private:
+	struct Tile {
+		unsigned int texId = -1;
+		unsigned long long lastUsed = 0;
+	};
+	struct Level {
+		int width = 0, height = 0, columns = 0, rows = 0;
+		std::vector<Tile> tiles;
+	};
+	unsigned int uploadTile(int level, int column, int row);
+	void evictTiles();
+
+	static int maxTextureSize;
+
+	std::shared_ptr<TileSource> source;
+	std::vector<Level> levels;
+	std::mutex tilesMutex;
+	unsigned long long frame = 0;
+	bool released = false;
+};
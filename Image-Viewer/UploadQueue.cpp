@@ -0,0 +1,183 @@
+#include "UploadQueue.h"
+#include <glad/glad.h>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+static double now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+UploadQueue::~UploadQueue()
+{
+	if (pixelBuffers != nullptr)
+		pixelBuffers->destroy();
+	delete pixelBuffers;
+	if (hasCurrent)
+		glDeleteTextures(1, &currentTexture);
+	if (!texturesToDelete.empty())
+		glDeleteTextures(texturesToDelete.size(), texturesToDelete.data());
+}
+
+bool UploadQueue::push(UploadJob job, int selectedIndex, UploadJob& evicted)
+{
+	std::lock_guard g(jobsMutex);
+	jobs.push_back(job);
+	if (jobs.size() <= capacity)
+		return true;
+	auto furthest = jobs.begin();
+	for (auto it = jobs.begin(); it != jobs.end(); it++) {
+		if (abs(it->index - selectedIndex) > abs(furthest->index - selectedIndex))
+			furthest = it;
+	}
+	evicted = *furthest;
+	jobs.erase(furthest);
+	return false;
+}
+
+void UploadQueue::deleteTexture(unsigned int texId)
+{
+	std::lock_guard g(jobsMutex);
+	texturesToDelete.push_back(texId);
+}
+
+int UploadQueue::getDepth()
+{
+	std::lock_guard g(jobsMutex);
+	return jobs.size() + (hasCurrent ? 1 : 0);
+}
+
+void UploadQueue::process(double budget, int selectedIndex, std::function<bool(const UploadJob&)> isWanted, std::function<void(const UploadJob&, unsigned int)> onFinished)
+{
+	double start = now();
+	std::vector<unsigned int> deleted;
+	jobsMutex.lock();
+	deleted.swap(texturesToDelete);
+	jobsMutex.unlock();
+	if (!deleted.empty())
+		glDeleteTextures(deleted.size(), deleted.data());
+
+	if (usePixelBuffers && pixelBuffers == nullptr) {
+		pixelBuffers = new PixelBufferRing(UPLOAD_CHUNK_BYTES);
+		if (!pixelBuffers->create()) {
+			delete pixelBuffers;
+			pixelBuffers = nullptr;
+			usePixelBuffers = false;
+		}
+	}
+
+	stalled = false;
+	while (now() - start < budget && !stalled) {
+		if (hasCurrent && !isWanted(current)) {
+			glDeleteTextures(1, &currentTexture);
+			hasCurrent = false;
+			onFinished(current, -1);
+		}
+		if (!hasCurrent) {
+			jobsMutex.lock();
+			if (jobs.empty()) {
+				jobsMutex.unlock();
+				return;
+			}
+			auto closest = jobs.begin();
+			for (auto it = jobs.begin(); it != jobs.end(); it++) {
+				if (abs(it->index - selectedIndex) < abs(closest->index - selectedIndex))
+					closest = it;
+			}
+			current = *closest;
+			jobs.erase(closest);
+			hasCurrent = true;
+			jobsMutex.unlock();
+			if (!isWanted(current)) {
+				hasCurrent = false;
+				onFinished(current, -1);
+				continue;
+			}
+			beginUpload();
+		}
+		if (uploadRows(budget, start)) {
+			glBindTexture(GL_TEXTURE_2D, currentTexture);
+			glGenerateMipmap(GL_TEXTURE_2D);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			hasCurrent = false;
+			onFinished(current, currentTexture);
+			// The pixels are in the texture now, the callback still reads their size
+			current.imageData.reset();
+		}
+	}
+}
+
+void UploadQueue::beginUpload()
+{
+	ImageData* data = current.imageData.get();
+	glGenTextures(1, &currentTexture);
+	glBindTexture(GL_TEXTURE_2D, currentTexture);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, data->width, data->height, 0, data->channels == 3 ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	uploadedRows = 0;
+}
+
+bool UploadQueue::uploadRows(double budget, double start)
+{
+	ImageData* data = current.imageData.get();
+	size_t rowBytes = (size_t)data->width * data->channels;
+	int chunkRows = std::max(1, (int)(UPLOAD_CHUNK_BYTES / rowBytes));
+	GLenum format = data->channels == 3 ? GL_RGB : GL_RGBA;
+
+	glBindTexture(GL_TEXTURE_2D, currentTexture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	while (uploadedRows < data->height) {
+		int rows = std::min(chunkRows, data->height - uploadedRows);
+		if (!uploadChunk(rows, rowBytes, format)) {
+			stalled = true;
+			break;
+		}
+		uploadedRows += rows;
+		if (now() - start >= budget)
+			break;
+	}
+	return uploadedRows >= data->height;
+}
+
+bool UploadQueue::uploadChunk(int rows, size_t rowBytes, GLenum format)
+{
+	ImageData* data = current.imageData.get();
+	unsigned char* source = data->data + uploadedRows * rowBytes;
+	double chunkStart = now();
+	bool pixelBufferPath = usePixelBuffers && pixelBuffers != nullptr && rows * rowBytes <= pixelBuffers->getSlotSize();
+	unsigned char* mapped = nullptr;
+	PixelBufferStatus status = pixelBufferPath ? pixelBuffers->acquire(mapped) : PIXEL_BUFFER_FAILED;
+	if (status == PIXEL_BUFFER_BUSY)
+		return false;	// the GPU still reads from every slot, continue in the next frame
+	if (pixelBufferPath && status == PIXEL_BUFFER_FAILED) {
+		// The driver won't map the buffers, the rest is uploaded from client memory
+		pixelBuffers->destroy();
+		delete pixelBuffers;
+		pixelBuffers = nullptr;
+		usePixelBuffers = false;
+		pixelBufferPath = false;
+	}
+	if (pixelBufferPath) {
+		memcpy(mapped, source, rows * rowBytes);
+		pixelBuffers->upload(0, uploadedRows, data->width, rows, format);
+	}
+	else {
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, uploadedRows, data->width, rows, format, GL_UNSIGNED_BYTE, source);
+	}
+	uploadedBytes[pixelBufferPath] += rows * rowBytes;
+	uploadSeconds[pixelBufferPath] += now() - chunkStart;
+	return true;
+}
+
+double UploadQueue::getThroughput(bool pixelBuffers)
+{
+	if (uploadSeconds[pixelBuffers] <= 0)
+		return 0;
+	return uploadedBytes[pixelBuffers] / uploadSeconds[pixelBuffers] / (1024.0 * 1024.0);
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <functional>
+#include "ImageData.h"
+#include "PixelBufferRing.h"
+
+#define UPLOAD_QUEUE_CAPACITY 4
+#define UPLOAD_CHUNK_BYTES (4 * 1024 * 1024)
+
+class TiledImage;
+
+struct UploadJob {
+	int index = -1;
+	unsigned int folderGeneration = 0;
+	ImageDataPtr imageData;
+	std::shared_ptr<TiledImage> tiles;
+	bool preview = false;				// reduced scale pass of an image that is fullWidth x fullHeight
+	int fullWidth = 0, fullHeight = 0;
+};
+
+// Decoded images waiting for their texture upload.
+// Filled by the loader thread, drained by the render thread with a time budget per frame,
+// large images are uploaded in row chunks over several frames.
+class UploadQueue
+{
+public:
+	UploadQueue(unsigned int capacity = UPLOAD_QUEUE_CAPACITY) : capacity(capacity) {}
+	// With the GL context current
+	~UploadQueue();
+
+	// Returns false when the queue was full and the job furthest from selectedIndex (returned in evicted) was dropped
+	bool push(UploadJob job, int selectedIndex, UploadJob& evicted);
+	void deleteTexture(unsigned int texId);
+	int getDepth();
+
+	void setUsePixelBuffers(bool use) { usePixelBuffers = use; }
+	bool getUsePixelBuffers() { return usePixelBuffers; }
+	// MB/s spent submitting texture data, for the pixel buffer path or the direct glTexSubImage2D path
+	double getThroughput(bool pixelBuffers);
+
+	// Only on the render thread with the GL context current.
+	// onFinished gets the finished texture, or -1 when the job was no longer wanted
+	void process(double budget, int selectedIndex, std::function<bool(const UploadJob&)> isWanted, std::function<void(const UploadJob&, unsigned int)> onFinished);
+private:
+	void beginUpload();
+	bool uploadRows(double budget, double start);
+	bool uploadChunk(int rows, size_t rowBytes, GLenum format);
+
+	unsigned int capacity;
+	std::mutex jobsMutex;
+	std::deque<UploadJob> jobs;
+	std::vector<unsigned int> texturesToDelete;
+
+	bool hasCurrent = false;
+	UploadJob current;
+	unsigned int currentTexture = -1;
+	int uploadedRows = 0;
+
+	bool usePixelBuffers = true;
+	PixelBufferRing* pixelBuffers = nullptr;
+	bool stalled = false;
+	double uploadedBytes[2] = { 0, 0 };
+	double uploadSeconds[2] = { 0, 0 };
+};
@@ -0,0 +1,230 @@
+#include "Warp.h"
+#include <cstring>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WARP_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Taps per axis of the widest filter at the largest scale
+#define WARP_MAX_TAPS (2 * 3 * WARP_MAX_FILTER_SCALE + 2)
+
+static const int64_t fixedOne = (int64_t)1 << WARP_FRACTION_BITS;
+static const int64_t fixedMask = fixedOne - 1;
+static const double fixedToPixels = 1.0 / fixedOne;
+
+const char* resampleFilterName(ResampleFilter filter)
+{
+	const char* names[RESAMPLE_COUNT] = { "Nearest", "Bilinear", "Bicubic", "Lanczos" };
+	return filter < RESAMPLE_COUNT ? names[filter] : "";
+}
+
+static int64_t toFixed(double pixels)
+{
+	// Far outside any image anyway, kept in range of the 64 bit positions
+	pixels = (std::max)(-1e9, (std::min)(1e9, pixels));
+	return (int64_t)llround(pixels * fixedOne);
+}
+
+static float filterRadius(ResampleFilter filter)
+{
+	return filter == RESAMPLE_LANCZOS ? 3.0f : filter == RESAMPLE_BICUBIC ? 2.0f : 1.0f;
+}
+
+// The kernel from 0 to its radius in steps of 1 / WARP_KERNEL_STEPS, computed once
+static const std::vector<float>& kernelTable(ResampleFilter filter)
+{
+	static const std::vector<float> bicubic = [] {
+		std::vector<float> table(2 * WARP_KERNEL_STEPS + 1);
+		for (size_t i = 0; i < table.size(); i++) {
+			// Keys with a = -0.5, the Catmull-Rom spline
+			double x = (double)i / WARP_KERNEL_STEPS;
+			table[i] = x < 1 ? 1.5 * x * x * x - 2.5 * x * x + 1 : -0.5 * x * x * x + 2.5 * x * x - 4 * x + 2;
+		}
+		return table;
+	}();
+	static const std::vector<float> lanczos = [] {
+		const double pi = 3.14159265358979323846;
+		std::vector<float> table(3 * WARP_KERNEL_STEPS + 1);
+		table[0] = 1.0f;
+		for (size_t i = 1; i < table.size(); i++) {
+			double x = (double)i / WARP_KERNEL_STEPS;
+			table[i] = 3 * sin(pi * x) * sin(pi * x / 3) / (pi * pi * x * x);
+		}
+		return table;
+	}();
+	return filter == RESAMPLE_LANCZOS ? lanczos : bicubic;
+}
+
+struct FilterSetup {
+	const float* table = nullptr;
+	int tableSize = 0;
+	double support = 1;		// in source pixels
+	double invScale = 1;
+};
+
+// Source indices, clamped to the edge, and normalized weights of the taps around center, which is in pixel center coordinates
+static int filterTaps(double center, int size, const FilterSetup& setup, int* index, float* weight)
+{
+	int first = (int)floor(center - setup.support) + 1;
+	int last = (int)floor(center + setup.support);
+	float total = 0;
+	int count = 0;
+	for (int i = first; i <= last && count < WARP_MAX_TAPS; i++) {
+		int step = (int)(fabs(i - center) * setup.invScale * WARP_KERNEL_STEPS);
+		float w = step < setup.tableSize ? setup.table[step] : 0.0f;
+		index[count] = (std::min)((std::max)(i, 0), size - 1);
+		weight[count] = w;
+		total += w;
+		count++;
+	}
+	if (total != 0) {
+		for (int i = 0; i < count; i++)
+			weight[i] /= total;
+	}
+	return count;
+}
+
+// Sum of weightY[j] * weightX[i] * pixel(indexX[i], indexY[j]) rounded into out
+template<int C>
+static void filterPixel(const ImageData& source, const int* indexX, const float* weightX, int countX,
+	const int* indexY, const float* weightY, int countY, unsigned char* out, int channels)
+{
+	size_t stride = (size_t)source.width * channels;
+#ifdef WARP_SSE2
+	if constexpr (C == 3 || C == 4) {
+		// A pixel as four floats, the fourth lane is unused for RGB
+		const __m128i zero = _mm_setzero_si128();
+		__m128 sum = _mm_setzero_ps();
+		for (int j = 0; j < countY; j++) {
+			const unsigned char* row = source.data + indexY[j] * stride;
+			__m128 rowSum = _mm_setzero_ps();
+			for (int i = 0; i < countX; i++) {
+				const unsigned char* from = row + indexX[i] * C;
+				// Assembled in a register, a 3 byte memcpy into a stack int stalls the load that follows it
+				int bytes = C == 4 ? from[0] | from[1] << 8 | from[2] << 16 | from[3] << 24 : from[0] | from[1] << 8 | from[2] << 16;
+				__m128i pixel = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero);
+				rowSum = _mm_add_ps(rowSum, _mm_mul_ps(_mm_cvtepi32_ps(pixel), _mm_set1_ps(weightX[i])));
+			}
+			sum = _mm_add_ps(sum, _mm_mul_ps(rowSum, _mm_set1_ps(weightY[j])));
+		}
+		__m128i rounded = _mm_cvtps_epi32(sum);
+		rounded = _mm_packus_epi16(_mm_packs_epi32(rounded, zero), zero);
+		int bytes = _mm_cvtsi128_si32(rounded);
+		memcpy(out, &bytes, C);
+		return;
+	}
+#endif
+	const int pixelChannels = C ? C : channels;
+	for (int c = 0; c < pixelChannels; c++) {
+		float sum = 0;
+		for (int j = 0; j < countY; j++) {
+			const unsigned char* row = source.data + indexY[j] * stride + c;
+			float rowSum = 0;
+			for (int i = 0; i < countX; i++)
+				rowSum += row[indexX[i] * pixelChannels] * weightX[i];
+			sum += rowSum * weightY[j];
+		}
+		out[c] = (unsigned char)(std::min)((std::max)(sum + 0.5f, 0.0f), 255.0f);
+	}
+}
+
+template<int C, int F>
+static void warpRow(const ImageData& source, const WarpMap& map, const FilterSetup& setup, int width, int y, unsigned char* out)
+{
+	const int channels = C ? C : source.channels;
+	int64_t positionX = toFixed(map.mapX[1] * y + map.mapX[2]);
+	int64_t positionY = toFixed(map.mapY[1] * y + map.mapY[2]);
+	const int64_t stepX = toFixed(map.mapX[0]), stepY = toFixed(map.mapY[0]);
+	const int64_t limitX = (int64_t)source.width << WARP_FRACTION_BITS, limitY = (int64_t)source.height << WARP_FRACTION_BITS;
+	const int64_t half = fixedOne / 2;
+	int indexX[WARP_MAX_TAPS], indexY[WARP_MAX_TAPS];
+	float weightX[WARP_MAX_TAPS], weightY[WARP_MAX_TAPS];
+
+	for (int x = 0; x < width; x++, out += channels, positionX += stepX, positionY += stepY) {
+		if (positionX < 0 || positionX >= limitX || positionY < 0 || positionY >= limitY) {
+			memset(out, 0, channels);
+			continue;
+		}
+		if constexpr (F == RESAMPLE_NEAREST) {
+			int sx = (int)(positionX >> WARP_FRACTION_BITS), sy = (int)(positionY >> WARP_FRACTION_BITS);
+			memcpy(out, source.data + ((size_t)sy * source.width + sx) * channels, channels);
+		}
+		else if constexpr (F == RESAMPLE_BILINEAR) {
+			// Relative to the pixel centers, the fraction is the weight of the next pixel
+			int64_t u = positionX - half, v = positionY - half;
+			int x0 = (int)(u >> WARP_FRACTION_BITS), y0 = (int)(v >> WARP_FRACTION_BITS);
+			float fx = (float)((u & fixedMask) * fixedToPixels), fy = (float)((v & fixedMask) * fixedToPixels);
+			indexX[0] = (std::max)(x0, 0);
+			indexX[1] = (std::min)(x0 + 1, source.width - 1);
+			indexY[0] = (std::max)(y0, 0);
+			indexY[1] = (std::min)(y0 + 1, source.height - 1);
+			weightX[0] = 1 - fx;
+			weightX[1] = fx;
+			weightY[0] = 1 - fy;
+			weightY[1] = fy;
+			filterPixel<C>(source, indexX, weightX, 2, indexY, weightY, 2, out, channels);
+		}
+		else {
+			int countX = filterTaps((positionX - half) * fixedToPixels, source.width, setup, indexX, weightX);
+			int countY = filterTaps((positionY - half) * fixedToPixels, source.height, setup, indexY, weightY);
+			filterPixel<C>(source, indexX, weightX, countX, indexY, weightY, countY, out, channels);
+		}
+	}
+}
+
+template<int C>
+static void warpRowsWith(const ImageData& source, const WarpMap& map, ResampleFilter filter, const FilterSetup& setup,
+	int width, int firstRow, int count, unsigned char* out)
+{
+	size_t rowBytes = (size_t)width * (C ? C : source.channels);
+	for (int y = firstRow; y < firstRow + count; y++, out += rowBytes) {
+		switch (filter)
+		{
+		case RESAMPLE_BILINEAR:
+			warpRow<C, RESAMPLE_BILINEAR>(source, map, setup, width, y, out);
+			break;
+		case RESAMPLE_BICUBIC:
+		case RESAMPLE_LANCZOS:
+			warpRow<C, RESAMPLE_BICUBIC>(source, map, setup, width, y, out);
+			break;
+		default:
+			warpRow<C, RESAMPLE_NEAREST>(source, map, setup, width, y, out);
+			break;
+		}
+	}
+}
+
+void warpRows(const ImageData& source, const WarpMap& map, ResampleFilter filter, int width, int firstRow, int count, unsigned char* out)
+{
+	FilterSetup setup;
+	if (filter == RESAMPLE_BICUBIC || filter == RESAMPLE_LANCZOS) {
+		const std::vector<float>& table = kernelTable(filter);
+		setup.table = table.data();
+		setup.tableSize = table.size();
+		// Shrinking, the kernel is stretched over as many source pixels as one output pixel covers so it doesn't alias
+		double scale = sqrt(fabs(map.mapX[0] * map.mapY[1] - map.mapX[1] * map.mapY[0]));
+		scale = (std::min)((std::max)(scale, 1.0), (double)WARP_MAX_FILTER_SCALE);
+		setup.support = filterRadius(filter) * scale;
+		setup.invScale = 1.0 / scale;
+	}
+	switch (source.channels)
+	{
+	case 1:
+		warpRowsWith<1>(source, map, filter, setup, width, firstRow, count, out);
+		break;
+	case 3:
+		warpRowsWith<3>(source, map, filter, setup, width, firstRow, count, out);
+		break;
+	case 4:
+		warpRowsWith<4>(source, map, filter, setup, width, firstRow, count, out);
+		break;
+	default:
+		warpRowsWith<0>(source, map, filter, setup, width, firstRow, count, out);
+		break;
+	}
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include "ImageData.h"
+
+// Fractional bits of the fixed point source positions stepped along a row, exact enough for rows of millions of pixels
+#define WARP_FRACTION_BITS 32
+// Kernel weights tabulated per source pixel of distance
+#define WARP_KERNEL_STEPS 1024
+// How far bicubic and Lanczos are widened when the output is smaller than the source, more would cost too many taps
+#define WARP_MAX_FILTER_SCALE 4
+
+enum ResampleFilter {
+	RESAMPLE_NEAREST = 0, RESAMPLE_BILINEAR, RESAMPLE_BICUBIC, RESAMPLE_LANCZOS, RESAMPLE_COUNT
+};
+const char* resampleFilterName(ResampleFilter filter);
+
+// An affine map from output pixel (x, y) to the source position (mapX[0] * x + mapX[1] * y + mapX[2], mapY[0] * x + mapY[1] * y + mapY[2]),
+// in source pixels with pixel i covering [i, i + 1). Output pixels whose position is outside the source are left black.
+struct WarpMap {
+	double mapX[3] = { 1, 0, 0.5 }, mapY[3] = { 0, 1, 0.5 };
+};
+
+// Output rows [firstRow, firstRow + count) of width pixels into out. Each row starts from its exact position
+// and steps it in fixed point, the filters read the source as floats a pixel at a time with SSE2 where there is one.
+// Reentrant, the callers split the rows over threads.
+void warpRows(const ImageData& source, const WarpMap& map, ResampleFilter filter, int width, int firstRow, int count, unsigned char* out);